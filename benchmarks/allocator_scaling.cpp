@@ -0,0 +1,109 @@
+// Allocation throughput from 1 to N threads.
+//
+// Every thread repeatedly allocates a batch of mixed-size blocks and frees it
+// again; a quarter of each batch is freed by the neighbouring thread so the
+// remote free path is exercised too. Prints operations per second for each
+// thread count, for the CachingAllocator and for plain malloc.
+//
+// Usage: allocator_scaling [max_threads] [iterations]
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Allocator.h"
+#include "CachingAllocator.h"
+
+using namespace enigma;
+
+namespace
+{
+  constexpr int kBatch = 64;
+
+  double run(Allocator &allocator, int num_threads, int iterations)
+  {
+    // Blocks handed to the next thread for freeing
+    std::vector<std::vector<void *>> outbox(num_threads);
+    std::vector<std::mutex> outbox_mutex(num_threads);
+    std::barrier start(num_threads + 1);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < num_threads; t++)
+    {
+      threads.emplace_back([&, t]
+                           {
+                             std::vector<void *> batch(kBatch);
+                             int next = (t + 1) % num_threads;
+                             start.arrive_and_wait();
+                             for (int i = 0; i < iterations; i++)
+                             {
+                               for (int b = 0; b < kBatch; b++)
+                                 batch[b] = allocator.allocate(size_t{32} << (b % 9)); // 32B .. 8KiB
+                               for (int b = 0; b < kBatch; b++)
+                               {
+                                 if (b % 4 == 0 && num_threads > 1)
+                                 {
+                                   std::lock_guard<std::mutex> lock(outbox_mutex[next]);
+                                   outbox[next].push_back(batch[b]);
+                                 }
+                                 else
+                                 {
+                                   allocator.deallocate(batch[b]);
+                                 }
+                               }
+                               if (i % 16 == 0)
+                               {
+                                 std::vector<void *> inbox;
+                                 {
+                                   std::lock_guard<std::mutex> lock(outbox_mutex[t]);
+                                   inbox.swap(outbox[t]);
+                                 }
+                                 for (void *block : inbox)
+                                   allocator.deallocate(block);
+                               }
+                             }
+                             start.arrive_and_wait();
+                           });
+    }
+
+    start.arrive_and_wait();
+    auto begin = std::chrono::steady_clock::now();
+    start.arrive_and_wait();
+    auto end = std::chrono::steady_clock::now();
+    for (auto &thread : threads)
+      thread.join();
+    for (auto &blocks : outbox)
+      for (void *block : blocks)
+        allocator.deallocate(block);
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    return 2.0 * kBatch * iterations * num_threads / seconds; // allocations + frees
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int max_threads = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 20000;
+
+  auto caching = std::static_pointer_cast<CachingAllocator>(get_device_allocator(Device(DeviceType::CPU)));
+  CPUAllocator system;
+
+  std::printf("%8s %18s %18s\n", "threads", "caching (Mops/s)", "malloc (Mops/s)");
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    double cached = run(*caching, threads, iterations);
+    double plain = run(system, threads, iterations);
+    std::printf("%8d %18.2f %18.2f\n", threads, cached / 1e6, plain / 1e6);
+    if (threads < max_threads && threads * 2 > max_threads)
+      threads = max_threads / 2; // always finish with max_threads
+  }
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Copy bandwidth of copy_bytes() against plain memcpy.
+//
+// Copies buffers from 64 KiB up to the given size (default 512 MiB) and prints
+// GB/s for each; the engine switches to worker threads at
+// kParallelCopyThreshold and to streaming stores past the last-level cache.
+//
+// Usage: copy_bandwidth [max_mib] [threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include "CopyEngine.h"
+
+using namespace enigma;
+
+namespace
+{
+  template <typename Fn>
+  double gigabytes_per_second(size_t num_bytes, Fn &&fn)
+  {
+    // Enough repetitions for ~1 GiB of traffic per measurement
+    int repeats = static_cast<int>(std::max<size_t>(1, (size_t{1} << 30) / num_bytes));
+    fn(); // fault the pages in
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+      fn();
+    auto end = std::chrono::steady_clock::now();
+    return double(num_bytes) * repeats / std::chrono::duration<double>(end - begin).count() / 1e9;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  size_t max_bytes = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 512) << 20;
+  if (argc > 2)
+    set_copy_threads(std::atoi(argv[2]));
+
+  auto map = [](size_t n)
+  {
+    return static_cast<char *>(mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  };
+  char *src = map(max_bytes);
+  char *dst = map(max_bytes);
+  std::memset(src, 1, max_bytes);
+
+  std::printf("LLC %zu KiB, %d copy threads\n", last_level_cache_bytes() >> 10, copy_threads());
+  std::printf("%12s %14s %14s\n", "bytes", "memcpy GB/s", "engine GB/s");
+  for (size_t size = 64 << 10; size <= max_bytes; size *= 4)
+  {
+    double plain = gigabytes_per_second(size, [&]
+                                        { std::memcpy(dst, src, size); });
+    double engine = gigabytes_per_second(size, [&]
+                                         { copy_bytes(dst, src, size); });
+    std::printf("%12zu %14.2f %14.2f\n", size, plain, engine);
+  }
+  munmap(src, max_bytes);
+  munmap(dst, max_bytes);
+  return 0;
+}
@@ -0,0 +1,78 @@
+// Lazy clone/drop throughput from 1 to N threads.
+//
+// All threads clone the same COW Storage and drop the clones again, so every
+// operation hits one shared COWDeleterContext. Prints clone+drop pairs per
+// second per thread count; with a lock-free context this should grow with the
+// threads until the shared counter's cache line becomes the limit.
+//
+// Usage: cow_clone_scaling [max_threads] [iterations]
+
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "COW.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+namespace
+{
+  constexpr int kBatch = 16;
+
+  double run(Storage &original, int num_threads, int iterations)
+  {
+    std::barrier start(num_threads + 1);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < num_threads; t++)
+    {
+      threads.emplace_back([&]
+                           {
+                             std::vector<StoragePtr> clones(kBatch);
+                             start.arrive_and_wait();
+                             for (int i = 0; i < iterations; i++)
+                             {
+                               for (auto &clone : clones)
+                                 clone = Storage::lazy_clone(original);
+                               for (auto &clone : clones)
+                                 clone.reset();
+                             }
+                             start.arrive_and_wait();
+                           });
+    }
+
+    start.arrive_and_wait();
+    auto begin = std::chrono::steady_clock::now();
+    start.arrive_and_wait();
+    auto end = std::chrono::steady_clock::now();
+    for (auto &thread : threads)
+      thread.join();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    return double(kBatch) * iterations * num_threads / seconds;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int max_threads = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 50000;
+
+  Storage original(1 << 16, Device(DeviceType::CPU));
+  // Make the original COW up front so the threads only ever share references
+  auto first = Storage::lazy_clone(original);
+
+  std::printf("%8s %22s\n", "threads", "clone+drop (Mops/s)");
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    double rate = run(original, threads, iterations);
+    std::printf("%8d %22.2f\n", threads, rate / 1e6);
+    if (threads < max_threads && threads * 2 > max_threads)
+      threads = max_threads / 2; // always finish with max_threads
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+// Cost of Scalar binary operators for every pair of Scalar types.
+//
+// Prints one ns/op table per operator, lhs types down the side and rhs types
+// across; "-" marks pairs the operator rejects.
+//
+// Usage: scalar_dispatch [iterations]
+
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include "Scalar.h"
+
+using namespace enigma;
+
+namespace
+{
+  // Keeps the optimizer from discarding the measured work
+  void escape(void *p)
+  {
+    asm volatile("" : : "g"(p) : "memory");
+  }
+
+  template <typename Op>
+  double nanoseconds_per_op(int iterations, const Scalar &lhs, const Scalar &rhs, Op op)
+  {
+    try
+    {
+      Scalar result = op(lhs, rhs);
+      escape(&result);
+    }
+    catch (const ScalarError &)
+    {
+      return -1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+      Scalar result = op(lhs, rhs);
+      escape(&result);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+  }
+
+  template <typename Op>
+  void print_table(const char *name, const std::vector<Scalar> &values, int iterations, Op op)
+  {
+    std::printf("\n%s (ns/op)\n%-12s", name, "");
+    for (const auto &rhs : values)
+      std::printf("%12s", Scalar::typeName(rhs.type()).c_str());
+    std::printf("\n");
+    for (const auto &lhs : values)
+    {
+      std::printf("%-12s", Scalar::typeName(lhs.type()).c_str());
+      for (const auto &rhs : values)
+      {
+        double ns = nanoseconds_per_op(iterations, lhs, rhs, op);
+        if (ns < 0)
+          std::printf("%12s", "-");
+        else
+          std::printf("%12.2f", ns);
+      }
+      std::printf("\n");
+    }
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+  // One value of each type a Scalar can hold, non-zero so division is defined
+  std::vector<Scalar> values = {
+      Scalar(int8_t(6)),
+      Scalar(int16_t(6)),
+      Scalar(int32_t(6)),
+      Scalar(int64_t(6)),
+      Scalar(uint8_t(3)),
+      Scalar(uint16_t(3)),
+      Scalar(uint32_t(3)),
+      Scalar(uint64_t(3)),
+      Scalar(2.5f),
+      Scalar(2.5),
+      Scalar(std::complex<float>(1.0f, 2.0f)),
+      Scalar(std::complex<double>(3.0, -1.0)),
+      Scalar(true),
+  };
+
+  print_table("a + b", values, iterations, [](const Scalar &a, const Scalar &b)
+              { return a + b; });
+  print_table("a - b", values, iterations, [](const Scalar &a, const Scalar &b)
+              { return a - b; });
+  print_table("a * b", values, iterations, [](const Scalar &a, const Scalar &b)
+              { return a * b; });
+  print_table("a / b", values, iterations, [](const Scalar &a, const Scalar &b)
+              { return a / b; });
+  return 0;
+}
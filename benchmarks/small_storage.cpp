@@ -0,0 +1,70 @@
+// Create/destroy cost of 1 to 64 byte Storages.
+//
+// Compares inline Storages with the same sizes forced through the allocator
+// (a 128-byte alignment disables the inline buffer), on the stack and behind a
+// StoragePtr.
+//
+// Usage: small_storage [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Storage.h"
+
+using namespace enigma;
+
+namespace
+{
+  // Keeps the optimizer from discarding the measured work
+  void escape(void *p)
+  {
+    asm volatile("" : : "g"(p) : "memory");
+  }
+
+  template <typename Fn>
+  double nanoseconds_per_op(int iterations, Fn &&fn)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+      fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 2000000;
+  Device cpu(DeviceType::CPU);
+  constexpr size_t kHeapAlignment = 2 * kDefaultAlignment;
+
+  std::printf("%6s %14s %14s %14s %14s\n", "bytes", "inline (ns)", "heap (ns)", "inline ptr", "heap ptr");
+  for (size_t size : {1, 4, 8, 16, 32, 64})
+  {
+    double inline_storage = nanoseconds_per_op(iterations, [&]
+                                               {
+                                                 Storage s(size, cpu);
+                                                 std::memset(s.data(), 0, size);
+                                                 escape(s.data());
+                                               });
+    double heap_storage = nanoseconds_per_op(iterations, [&]
+                                             {
+                                               Storage s(size, cpu, kHeapAlignment);
+                                               std::memset(s.data(), 0, size);
+                                               escape(s.data());
+                                             });
+    double inline_ptr = nanoseconds_per_op(iterations, [&]
+                                           {
+                                             auto s = Storage::create(size, cpu);
+                                             escape(s->data());
+                                           });
+    double heap_ptr = nanoseconds_per_op(iterations, [&]
+                                         {
+                                           auto s = Storage::create(size, cpu, kHeapAlignment);
+                                           escape(s->data());
+                                         });
+    std::printf("%6zu %14.2f %14.2f %14.2f %14.2f\n", size, inline_storage, heap_storage, inline_ptr, heap_ptr);
+  }
+  return 0;
+}
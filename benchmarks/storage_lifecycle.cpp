@@ -0,0 +1,117 @@
+// Cost of the DataPtr handle and of the Storage create/destroy path.
+//
+// Compares DataPtr against a replica of its previous layout (std::function
+// deleter, per-pointer mutex, deleter id and alignment) for object size and
+// construct/destroy time, then times whole small Storages, inline and behind
+// a shared handle (std::shared_ptr versus the co-allocating StoragePtr).
+//
+// Usage: storage_lifecycle [iterations]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "Allocator.h"
+#include "DataPtr.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+namespace
+{
+  // The handle as it was before the function-pointer redesign
+  struct LegacyDataPtr
+  {
+    void *data;
+    void *ctx;
+    std::function<void(LegacyDataPtr *)> deleter;
+    Device device;
+    uintptr_t deleter_id;
+    size_t alignment;
+    std::mutex release_mutex;
+
+    LegacyDataPtr(void *data, void *ctx, std::function<void(LegacyDataPtr *)> deleter, Device device)
+        : data(data), ctx(ctx), deleter(std::move(deleter)), device(device), deleter_id(0), alignment(64) {}
+    ~LegacyDataPtr()
+    {
+      if (deleter)
+        deleter(this);
+    }
+  };
+
+  void noop_deleter(DataPtr *) {}
+
+  // Keeps the optimizer from discarding the measured work
+  void escape(void *p)
+  {
+    asm volatile("" : : "g"(p) : "memory");
+  }
+
+  template <typename Fn>
+  double nanoseconds_per_op(int iterations, Fn &&fn)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+      fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 2000000;
+  Allocator *allocator = get_allocator(Device(DeviceType::CPU)).get();
+  int counter = 0;
+
+  std::printf("sizeof(DataPtr)        %4zu bytes\n", sizeof(DataPtr));
+  std::printf("sizeof(legacy DataPtr) %4zu bytes\n\n", sizeof(LegacyDataPtr));
+
+  // Deleter carrying its allocator, as Storage used to build it
+  double legacy = nanoseconds_per_op(iterations, [&]
+                                     {
+                                       auto ptr = std::make_unique<LegacyDataPtr>(
+                                           &counter, nullptr, [allocator](LegacyDataPtr *) { escape(allocator); },
+                                           Device(DeviceType::CPU));
+                                       escape(ptr.get());
+                                     });
+  double heap = nanoseconds_per_op(iterations, [&]
+                                   {
+                                     auto ptr = std::make_unique<DataPtr>(&counter, allocator, noop_deleter,
+                                                                          Device(DeviceType::CPU));
+                                     escape(ptr.get());
+                                   });
+  double inline_ptr = nanoseconds_per_op(iterations, [&]
+                                         {
+                                           DataPtr ptr(&counter, allocator, noop_deleter, Device(DeviceType::CPU));
+                                           escape(&ptr);
+                                         });
+  std::printf("legacy DataPtr, heap   %8.2f ns\n", legacy);
+  std::printf("DataPtr, heap          %8.2f ns\n", heap);
+  std::printf("DataPtr, inline        %8.2f ns\n\n", inline_ptr);
+
+  for (size_t size : {64, 1024, 16384})
+  {
+    double storage = nanoseconds_per_op(iterations, [&]
+                                        {
+                                          Storage s(size, Device(DeviceType::CPU));
+                                          escape(s.data());
+                                        });
+    double shared = nanoseconds_per_op(iterations, [&]
+                                       {
+                                         auto s = std::make_shared<Storage>(size, Device(DeviceType::CPU));
+                                         escape(s->data());
+                                       });
+    double intrusive = nanoseconds_per_op(iterations, [&]
+                                          {
+                                            auto s = Storage::create(size, Device(DeviceType::CPU));
+                                            escape(s->data());
+                                          });
+    std::printf("Storage(%5zu) create+destroy %8.2f ns, shared_ptr %8.2f ns, StoragePtr %8.2f ns\n",
+                size, storage, shared, intrusive);
+  }
+  return 0;
+}
@@ -1,30 +1,66 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include "Device.h"
 
 namespace enigma
 {
+  class DataPtr;
+
+  // Cache line / AVX-512 register width. Every allocation is at least this aligned
+  // unless a caller asks for something stricter.
+  constexpr size_t kDefaultAlignment = 64;
+
+  // System page size, for callers that want page-aligned buffers.
+  size_t page_size();
+
+  inline bool is_valid_alignment(size_t alignment)
+  {
+    return alignment != 0 && (alignment & (alignment - 1)) == 0;
+  }
+
+  inline bool is_aligned(const void *ptr, size_t alignment)
+  {
+    return (reinterpret_cast<uintptr_t>(ptr) & (alignment - 1)) == 0;
+  }
+
   class Allocator
   {
     public:
       virtual ~Allocator() = default;
-      virtual void * allocate(size_t num_bytes) = 0;
+      // `alignment` must be a power of two; the returned pointer is a multiple of it.
+      virtual void * allocate(size_t num_bytes, size_t alignment = kDefaultAlignment) = 0;
       virtual void deallocate(void * ptr) = 0;
+      // Resizes a block from allocate(), keeping its first min(old_bytes, new_bytes)
+      // bytes; `ptr` is invalid afterwards unless returned. The default moves the
+      // data into a fresh block, allocators override it to grow or shrink in place.
+      virtual void * reallocate(void * ptr, size_t old_bytes, size_t new_bytes, size_t alignment = kDefaultAlignment);
       virtual Device device() const = 0;
   };
 
   class CPUAllocator : public Allocator
   {
     public:
-      void * allocate(size_t num_bytes) override;
+      void * allocate(size_t num_bytes, size_t alignment = kDefaultAlignment) override;
       void deallocate(void * ptr) override;
+      void * reallocate(void * ptr, size_t old_bytes, size_t new_bytes, size_t alignment = kDefaultAlignment) override;
       Device device() const override { return Device(DeviceType::CPU); }
   };
 
-  // will implement CUDAAllocator here or in the CUDA folder (depends on my mood) :)
+  // DataPtr deleter for a block whose context is the Allocator it came from;
+  // that allocator must outlive the DataPtr.
+  void deallocate_data_ptr(DataPtr *data_ptr);
 
+  // Allocator new Storages on `device` should use: the innermost ArenaScope of
+  // the calling thread for CPU devices, otherwise get_device_allocator().
+  // Device allocators live for the whole process; an arena only while its
+  // scope is active, so buffers from it must not escape the scope.
   std:: shared_ptr<Allocator> get_allocator(const Device & device); 
 
+  // Process-wide allocator of `device`, ignoring any active ArenaScope: the one
+  // its registered Backend provides.
+  std::shared_ptr<Allocator> get_device_allocator(const Device &device);
+
 } // namespace enigma
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Allocator.h"
+#include "Device.h"
+
+namespace enigma
+{
+  // Bump-pointer allocator for short-lived temporaries.
+  //
+  // Memory is carved out of large chunks obtained from the device allocator;
+  // deallocate() is a no-op and everything is reclaimed at once by rewinding
+  // the bump pointer with reset(). Chunks are kept for reuse until release().
+  // An arena is meant to be used by a single thread.
+  class ArenaAllocator : public Allocator
+  {
+  public:
+    static constexpr size_t kDefaultChunkSize = 4 << 20;
+
+    // Position of the bump pointer, used to rewind nested scopes
+    struct Mark
+    {
+      size_t chunk;
+      size_t offset;
+    };
+
+    explicit ArenaAllocator(Device device = Device(DeviceType::CPU), size_t chunk_size = kDefaultChunkSize);
+    ~ArenaAllocator() override;
+
+    void *allocate(size_t num_bytes, size_t alignment = kDefaultAlignment) override;
+    void deallocate(void *) override {}
+    Device device() const override { return device_; }
+
+    Mark mark() const { return {current_, offset_}; }
+    // O(1): rewinds to `mark`, everything allocated after it becomes reusable
+    void reset(Mark mark);
+    void reset() { reset({0, 0}); }
+    // Hands all chunks back to the device allocator
+    void release();
+
+    // Bytes handed out since the last full reset (including alignment padding)
+    size_t used_bytes() const;
+    // Bytes held in chunks
+    size_t capacity_bytes() const;
+
+    ArenaAllocator(const ArenaAllocator &) = delete;
+    ArenaAllocator &operator=(const ArenaAllocator &) = delete;
+
+  private:
+    struct Chunk
+    {
+      char *base;
+      size_t size;
+    };
+
+    Device device_;
+    size_t chunk_size_;
+    std::shared_ptr<Allocator> backing_;
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0; // index of the chunk being bumped
+    size_t offset_ = 0;  // bump offset inside it
+
+    void next_chunk(size_t num_bytes, size_t alignment);
+  };
+
+  // RAII scope routing CPU allocations of the calling thread to an arena.
+  //
+  // While a scope is active, get_allocator() for a CPU device returns the arena,
+  // so every Storage created on this thread bump-allocates. Leaving the scope
+  // rewinds the arena to where it was on entry; Storages created inside must
+  // not outlive the scope. That includes COW clones and co-allocated payloads
+  // of them: their DataPtrs keep a raw pointer to the arena, and Storage
+  // relies on the allocator outliving every DataPtr built from it. Scopes
+  // nest, and the default constructor uses a per-thread arena that is reused
+  // across scopes.
+  class ArenaScope
+  {
+  public:
+    ArenaScope();
+    explicit ArenaScope(std::shared_ptr<ArenaAllocator> arena);
+    ~ArenaScope();
+
+    ArenaAllocator &arena() const { return *arena_; }
+
+    // Arena of the innermost active scope on this thread, or null
+    static const std::shared_ptr<ArenaAllocator> &current();
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+  private:
+    std::shared_ptr<ArenaAllocator> arena_;
+    ArenaAllocator::Mark mark_;
+    std::shared_ptr<ArenaAllocator> previous_;
+  };
+
+} // namespace enigma
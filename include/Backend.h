@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "Allocator.h"
+#include "Device.h"
+#include "DeviceType.h"
+
+namespace enigma
+{
+  // Identifies an asynchronous copy; 0 means it completed before returning
+  using CopyTicket = uint64_t;
+
+  // Everything the core needs from one device type: its memory, how bytes
+  // move in and out of it, and how to wait for that. Backends register once
+  // per DeviceType and live for the rest of the process.
+  class Backend
+  {
+  public:
+    virtual ~Backend() = default;
+
+    virtual DeviceType type() const = 0;
+
+    // Process-wide allocator for `device`, which has this backend's type
+    virtual std::shared_ptr<Allocator> allocator(const Device &device) = 0;
+
+    // Copies between this backend's memory and the host's, or within this
+    // backend. Returns when the bytes are in place.
+    virtual void copy(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+                      size_t num_bytes) = 0;
+
+    // Starts a copy like copy(); the buffers must stay valid until it
+    // completes. Copies started by one thread complete in order.
+    virtual CopyTicket copy_async(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+                                  size_t num_bytes)
+    {
+      copy(dst, dst_device, src, src_device, num_bytes);
+      return 0;
+    }
+    virtual bool is_complete(CopyTicket ticket) const { return ticket == 0; }
+    virtual void wait(CopyTicket) {}
+    // Waits for every copy started so far
+    virtual void synchronize() {}
+  };
+
+  // Makes `backend` handle its type. Throws std::invalid_argument if the type
+  // already has a backend; CPU, SIM and META are built in.
+  void register_backend(std::unique_ptr<Backend> backend);
+  bool has_backend(DeviceType type);
+  // Throws std::invalid_argument when nothing is registered for `type`.
+  Backend &get_backend(DeviceType type);
+
+  // Copies between any two devices through the backend of the non-CPU side
+  // (the destination's, if both are devices).
+  void copy_between_devices(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+                            size_t num_bytes);
+
+} // namespace enigma
@@ -2,10 +2,9 @@
 
 #include <memory>
 #include <atomic>
-#include <shared_mutex>
-#include <variant>
 #include <cstdint>
 #include <stdexcept>
+#include <vector>
 #include "DataPtr.h"
 #include "Storage.h"
 
@@ -22,72 +21,53 @@ namespace enigma::cow
     RefCountError(const std::string &msg) : COWError(msg) {}
     RefCountError(const char *msg) : COWError(msg) {}
   };
-  class ReadGuard
+  struct COWStats
   {
-    std::shared_lock<std::shared_mutex> lock_;
-
-  public:
-    explicit ReadGuard(std::shared_mutex &mutex)
-        : lock_(mutex) {}
-    ~ReadGuard() = default;
-  };
-
-  class WriteGuard
-  {
-    std::unique_lock<std::shared_mutex> lock_;
-
-  public:
-    explicit WriteGuard(std::shared_mutex &mutex)
-        : lock_(mutex) {}
-    ~WriteGuard() = default;
+    int64_t clones = 0;         // lazy clones made, of any kind
+    int64_t live_contexts = 0;  // COWDeleterContexts currently alive
+    int64_t copies = 0;         // materializations (or chunk copy-ins) that copied data
+    int64_t handoffs = 0;       // materializations by the last reference, no copy
+    int64_t bytes_cloned = 0;   // size of all clones made
+    int64_t bytes_copied = 0;   // copied by clones and materializations
+    int64_t bytes_avoided = 0;  // bytes_cloned not (yet) copied
+    int64_t copy_ns = 0;        // writers stalled in materialization copies
   };
 
-  using RefCountResult = std::variant<std::shared_lock<std::shared_mutex>, // Still shared
-                                      void *>;                             // Last reference
+  // Process-wide COW counters. Pages the kernel copies for kernel-COW clones
+  // are not seen here. Recording is a relaxed add on a per-thread shard.
+  COWStats cow_stats();
+  void reset_cow_stats();
 
+  // A DataPtr is COW exactly when this is its deleter
   class COWDeleter
   {
   public:
     static void deleter(DataPtr *d_ptr);
-    static uintptr_t identifier()
-    {
-      return reinterpret_cast<uintptr_t>(&deleter);
-    }
   };
 
+  // Shared by every COW DataPtr over one buffer. Only the count changes after
+  // construction, so no locks: increments are relaxed, decrements acq_rel, so
+  // the thread dropping the last reference synchronizes with all the others
+  // before handing the buffer back to its original deleter.
   class COWDeleterContext
   {
   private:
-    mutable std::shared_mutex mutex_;
     std::atomic<int64_t> refcount_;
-    // std::unique_ptr<void, DataPtr::DeleterFn> original_ctx_;
-    void *original_ctx_;
-    DataPtr::DeleterFn data_deleter_;
-
-    enum class State
-    {
-      Active,
-      PendingDelete,
-      Deleted
-    };
-    std::atomic<State> state_;
+    void *const original_ctx_;
+    const DataPtr::DeleterFn data_deleter_;
 
   public:
-    std::shared_lock<std::shared_mutex> get_shared_lock()
-    {
-      return std::shared_lock<std::shared_mutex>(mutex_);
-    }
-
     explicit COWDeleterContext(void *ctx, DataPtr::DeleterFn deleter);
     ~COWDeleterContext();
 
     void increment_refcount(int cnt);
-    RefCountResult decrement_refcount();
+    // True when this dropped the last reference; every other owner's accesses
+    // to the buffer then happen-before the caller's
+    bool decrement_refcount();
     int64_t reference_count() const;
 
-    void *get_original_ctx() const;
-    DataPtr::DeleterFn get_original_deleter() const;
-    std::shared_mutex &mutex() { return mutex_; }
+    void *get_original_ctx() const { return original_ctx_; }
+    DataPtr::DeleterFn get_original_deleter() const { return data_deleter_; }
 
     bool is_active() const;
 
@@ -98,14 +78,63 @@ namespace enigma::cow
     COWDeleterContext &operator=(COWDeleterContext &&) = delete;
   };
 
-  std::unique_ptr<DataPtr> make_cow_data_ptr(
+  // Private copy of a shared COW buffer, made one chunk at a time. The clone
+  // reserves address space for the whole buffer but only chunks copied into it
+  // get pages, so its memory use follows what was actually written.
+  class ChunkedCOW
+  {
+  private:
+    DataPtr source_; // COW reference keeping the shared buffer alive
+    size_t size_bytes_;
+    size_t chunk_bytes_;
+    std::vector<uint64_t> owned_; // one bit per chunk already copied
+    size_t num_owned_;
+
+    size_t first_chunk(size_t offset) const { return offset / chunk_bytes_; }
+    size_t end_chunk(size_t offset, size_t length) const;
+
+  public:
+    ChunkedCOW(DataPtr source, size_t size_bytes, size_t chunk_bytes);
+
+    // Zero-filled-on-demand region of `size_bytes` for the private chunks
+    static DataPtr reserve_region(size_t size_bytes, const Device &device);
+
+    const void *source() const { return source_.get(); }
+    size_t chunk_bytes() const { return chunk_bytes_; }
+    size_t num_chunks() const;
+    size_t owned_chunks() const { return num_owned_; }
+    bool is_owned(size_t chunk) const { return owned_[chunk / 64] >> (chunk % 64) & 1; }
+    bool complete() const { return num_owned_ == num_chunks(); }
+
+    // Whether every chunk overlapping [offset, offset + length) is still shared / already copied
+    bool all_shared(size_t offset, size_t length) const;
+    bool all_owned(size_t offset, size_t length) const;
+    // Copies the still-shared chunks overlapping [offset, offset + length) into `region`
+    void copy_in(void *region, size_t offset, size_t length);
+  };
+
+  DataPtr make_cow_data_ptr(
       DataPtr &src_ptr,
       COWDeleterContext &ctx);
 
-  std::unique_ptr<DataPtr> copy_cow_data_ptr(
+  DataPtr copy_cow_data_ptr(
       DataPtr &src_ptr);
 
-  std::shared_ptr<Storage> lazy_clone_storage(Storage &storage);
+  // Mapping of a memfd for kernel-assisted COW. Until the first clone it is
+  // the file's only mapping and MAP_SHARED; cloning freezes the file, remapping
+  // it MAP_PRIVATE in place, so from then on the kernel copies just the pages
+  // each mapping writes and the file keeps the bytes as of the freeze.
+  DataPtr make_kernel_cow_data_ptr(size_t size_bytes, const Device &device);
+  bool is_kernel_cow_data_ptr(const DataPtr &data_ptr);
+  // New MAP_PRIVATE mapping with the contents of `data_ptr`, or an empty
+  // DataPtr once `data_ptr` has written pages of its own (the file no longer
+  // matches what it shows)
+  DataPtr clone_kernel_cow_data_ptr(DataPtr &data_ptr);
+
+  // New COW reference to `data_ptr`, turning it into a COW DataPtr first if needed
+  DataPtr share_cow_data_ptr(DataPtr &data_ptr);
+
+  StoragePtr lazy_clone_storage(Storage &storage);
   void materialize_cow_storage(Storage &storage);
   bool is_cow_data_ptr(const DataPtr &data_ptr);
 
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Allocator.h"
+#include "Device.h"
+#include "PagePolicy.h"
+
+namespace enigma
+{
+  // Process-wide caching allocator.
+  //
+  // Small and medium requests are served by a binary buddy system carved out of
+  // fixed size segments: every request is rounded up to a power-of-two size
+  // class, larger free blocks are split on demand and freed blocks are
+  // coalesced with their buddy. Requests above the segment size are rounded to
+  // a multiple of it and cached as whole blocks. Nothing is handed back to the
+  // system until empty_cache() is called, so steady-state allocation is a free
+  // list pop.
+  //
+  // Buddy blocks are naturally aligned to their own size and segments to
+  // kSegmentSize, so alignment is honoured by bumping the size class.
+  //
+  // Segments are fresh anonymous mappings. For a CPU device naming a NUMA node
+  // ("cpu:1") they are bound to that node before first touch. Requests covered
+  // by the PagePolicy take the large-block path so they can be given huge pages
+  // and prefaulted.
+  //
+  // Blocks up to kMaxCachedBlockSize go through per-thread magazines: a thread
+  // frees into and allocates from its own small stack per size class without
+  // taking the lock, which is only needed to refill from or spill back to the
+  // buddy system. A block remembers the thread cache it was handed out by, and
+  // a block freed on another thread is pushed onto that cache's lock-free
+  // remote queue, to be picked up on its owner's next miss.
+  class CachingAllocator : public Allocator
+  {
+  public:
+    static constexpr size_t kMinBlockSize = 64;      // order 0
+    static constexpr size_t kSegmentSize = 4 << 20; // largest buddy order
+    static constexpr int kNumOrders = 17;            // 64B .. 4MiB
+    static constexpr size_t kMaxCachedBlockSize = 64 << 10;
+    static constexpr size_t kMagazineBytes = 256 << 10; // per size class and thread
+    static constexpr int kMaxThreadCaches = 1024;       // further threads take the lock
+
+    explicit CachingAllocator(Device device);
+    ~CachingAllocator() override;
+
+    void *allocate(size_t num_bytes, size_t alignment = kDefaultAlignment) override;
+    void deallocate(void *ptr) override;
+    // In place when the block's size class still fits or, for large blocks, by
+    // trimming or remapping pages (mremap) rather than copying them.
+    void *reallocate(void *ptr, size_t old_bytes, size_t new_bytes, size_t alignment = kDefaultAlignment) override;
+    Device device() const override { return device_; }
+
+    // Returns every fully free segment and cached large block to the system,
+    // after flushing the calling thread's magazines and all remote queues.
+    void empty_cache();
+
+    // Applies to allocations made after the call.
+    void set_page_policy(const PagePolicy &policy);
+    PagePolicy page_policy() const;
+
+    // Bytes currently obtained from the system (in use + cached).
+    size_t reserved_bytes() const;
+    // Bytes currently handed out, after size-class rounding. Blocks waiting in
+    // thread caches do not count.
+    size_t allocated_bytes() const;
+
+    // Size class a request of num_bytes is served from.
+    static size_t round_size(size_t num_bytes);
+
+    CachingAllocator(const CachingAllocator &) = delete;
+    CachingAllocator &operator=(const CachingAllocator &) = delete;
+
+  private:
+    static constexpr int kNumCachedOrders = 11; // 64B .. kMaxCachedBlockSize
+    static constexpr int kMagazineCapacity = 64;
+    static constexpr int kRadixBits = 13; // two levels cover 48-bit addresses
+
+    // Free blocks are threaded through their own memory.
+    struct FreeBlock
+    {
+      FreeBlock *prev;
+      FreeBlock *next;
+    };
+
+    // Block on a remote queue, also threaded through its own memory
+    struct RemoteBlock
+    {
+      RemoteBlock *next;
+      int order;
+    };
+
+    struct Segment
+    {
+      char *base;
+      size_t size;
+      bool large;
+      bool huge_pages; // advised with MADV_HUGEPAGE
+      // Per kMinBlockSize slot: tag of the block starting there (buddy only).
+      // Atomic because a thread cache flags its own blocks without the lock.
+      std::unique_ptr<std::atomic<uint8_t>[]> tags;
+      // Per slot: id of the thread cache that handed the block out, 0 for none.
+      std::vector<uint16_t> owners;
+    };
+
+    struct ThreadCache
+    {
+      struct Magazine
+      {
+        std::array<char *, kMagazineCapacity> blocks;
+        int count = 0;
+      };
+
+      uint16_t id;
+      bool bound = false; // to a live thread, guarded by mutex_
+      std::array<Magazine, kNumCachedOrders> magazines{};
+      std::atomic<int64_t> cached_bytes{0}; // written by the bound thread only
+      std::atomic<RemoteBlock *> remote{nullptr};
+      std::atomic<int64_t> remote_bytes{0};
+    };
+    struct ThreadBindings;
+
+    // Lock-free segment lookup for the thread cache paths, keyed by ptr / kSegmentSize
+    struct SegmentLeaf
+    {
+      std::array<std::atomic<Segment *>, size_t{1} << kRadixBits> segments{};
+    };
+
+    Device device_;
+    int numa_node_;
+    uint64_t uid_; // never reused, unlike `this`
+    PagePolicy policy_;
+    std::atomic<size_t> huge_page_threshold_; // policy_ mirror for the lock-free path
+    mutable std::mutex mutex_;
+    std::array<FreeBlock *, kNumOrders> free_lists_{};
+    std::unordered_map<uintptr_t, Segment *> segments_;
+    std::array<std::atomic<SegmentLeaf *>, size_t{1} << kRadixBits> segment_map_{};
+    std::multimap<size_t, Segment *> free_large_;
+    std::array<std::atomic<ThreadCache *>, kMaxThreadCaches> caches_{};
+    int num_caches_ = 0;
+    size_t reserved_bytes_ = 0;
+    size_t allocated_bytes_ = 0; // out of the buddy system, including thread caches
+
+    static int order_for(size_t num_bytes);
+    static int magazine_limit(int order);
+
+    void push_free(int order, char *block);
+    void remove_free(int order, char *block);
+    char *pop_free(int order);
+
+    char *allocate_buddy(int order);
+    void release_buddy(Segment *segment, size_t index, int order);
+    void free_buddy(Segment *segment, char *ptr);
+    void *allocate_large(size_t num_bytes);
+    void free_large(Segment *segment);
+    bool resize_large(Segment *segment, size_t new_size);
+
+    Segment *new_segment(size_t size, bool large);
+    void release_segment(Segment *segment);
+    void index_segment(Segment *segment, bool present);
+    Segment *find_segment(const void *ptr) const;
+
+    // Calling thread's cache, bound on first use when `bind` is set; null once
+    // the thread is exiting or kMaxThreadCaches are taken.
+    ThreadCache *thread_cache(bool bind);
+    char *cached_allocate(ThreadCache *cache, int order);
+    bool cached_free(Segment *segment, char *ptr);
+    // Called with mutex_ held
+    void flush_magazine(ThreadCache *cache, int order, int keep);
+    void drain_remote(ThreadCache *cache);
+    void reclaim_thread_caches();
+    void retire_thread_cache(ThreadCache *cache);
+  };
+
+  // Drops cached, unused memory held by the process-wide allocators.
+  void empty_cache();
+
+  // Sets the PagePolicy of the process-wide allocator of `device`; a CPU device
+  // without an index updates every NUMA node.
+  void set_page_policy(const Device &device, const PagePolicy &policy);
+
+} // namespace enigma
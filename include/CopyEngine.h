@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace enigma
+{
+  // Copies smaller than this run on the calling thread alone
+  constexpr size_t kParallelCopyThreshold = 4 << 20;
+  // Every helper thread gets at least this much of a parallel copy
+  constexpr size_t kMinCopyBytesPerThread = 1 << 20;
+
+  // memcpy for large buffers. Copies of kParallelCopyThreshold or more are split
+  // across a process-wide pool of worker threads, and copies bigger than the
+  // last-level cache use non-temporal stores so they do not evict the
+  // working set of everything else. Ranges must not overlap.
+  void copy_bytes(void *dst, const void *src, size_t num_bytes);
+
+  // Size of the last-level cache, as reported by the system (32 MiB if unknown).
+  size_t last_level_cache_bytes();
+
+  // Threads a large copy may use, including the caller. Defaults to the number
+  // of hardware threads; set 1 to keep every copy on the calling thread.
+  int copy_threads();
+  void set_copy_threads(int num_threads);
+
+} // namespace enigma
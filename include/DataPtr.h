@@ -1,44 +1,77 @@
 #pragma once
 
 #include "Device.h"
-#include <functional>
-#include <memory>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <utility>
 #include "DEBUG.h"
 
 namespace enigma
 {
 
+  // Owning handle to a block of device memory: the data pointer, an opaque
+  // context for the deleter (typically the allocator, or a COW context) and the
+  // function releasing them. Four words, no locks and no heap allocation;
+  // movable but not copyable.
   class DataPtr
   {
   public:
-    using DeleterFn = std::function<void(DataPtr *)>; // will be used for custom deletion of data
+    using DeleterFn = void (*)(DataPtr *); // receives the DataPtr being destroyed
 
   private:
     void *data_;
     void *ctx_;
     DeleterFn deleter_;
     Device device_;
-    uintptr_t deleter_id_;
-    std::mutex release_mutex_;
-    // std::atomic<int64_t> ptr_refcount_;
 
   public:
-    static constexpr uintptr_t INVALID_DELETER_ID = 0;
+    // Largest alignment inferred for pointers whose allocator did not record one
+    static constexpr size_t MAX_INFERRED_ALIGNMENT = 4096;
+
+    // Alignment an arbitrary pointer happens to have
+    static size_t alignment_of(const void *data)
+    {
+      auto address = reinterpret_cast<uintptr_t>(data);
+      if (address == 0)
+        return MAX_INFERRED_ALIGNMENT;
+      return std::min(size_t{1} << std::countr_zero(address), MAX_INFERRED_ALIGNMENT);
+    }
+
     // Constructors
-    DataPtr() : data_(nullptr), ctx_(nullptr), deleter_(nullptr), device_(DeviceType::CPU), deleter_id_(INVALID_DELETER_ID)
+    DataPtr() : data_(nullptr), ctx_(nullptr), deleter_(nullptr), device_(DeviceType::CPU)
     {
     }
-    DataPtr(void *data, void *ctx, DeleterFn deleter, Device device, uintptr_t deleter_id = INVALID_DELETER_ID)
-        : data_(data), ctx_(ctx), deleter_(std::move(deleter)), device_(device), deleter_id_(deleter_id)
+    DataPtr(void *data, void *ctx, DeleterFn deleter, Device device)
+        : data_(data), ctx_(ctx), deleter_(deleter), device_(device)
     {
     }
 
-    ~DataPtr()
+    DataPtr(DataPtr &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), ctx_(std::exchange(other.ctx_, nullptr)),
+          deleter_(std::exchange(other.deleter_, nullptr)), device_(other.device_)
     {
+    }
 
-      deleter_(this);
-      ctx_ = nullptr;  // since this ptr is deleted
-      data_ = nullptr; // same reason
+    DataPtr &operator=(DataPtr &&other) noexcept
+    {
+      if (this != &other)
+      {
+        clear();
+        data_ = std::exchange(other.data_, nullptr);
+        ctx_ = std::exchange(other.ctx_, nullptr);
+        deleter_ = std::exchange(other.deleter_, nullptr);
+        device_ = other.device_;
+      }
+      return *this;
+    }
+
+    DataPtr(const DataPtr &) = delete;
+    DataPtr &operator=(const DataPtr &) = delete;
+
+    ~DataPtr()
+    {
+      clear();
     }
 
     // Getters
@@ -50,7 +83,7 @@ namespace enigma
     {
       return ctx_;
     }
-    const DeleterFn &get_deleter() const
+    DeleterFn get_deleter() const
     {
       return deleter_;
     }
@@ -58,15 +91,12 @@ namespace enigma
     {
       return device_;
     }
-    uintptr_t get_deleter_id() const
+    // Alignment data() is known to have, inferred from its address
+    size_t alignment() const
     {
-      return deleter_id_;
+      return alignment_of(data_);
     }
 
-    void set_deleter_id(uintptr_t id)
-    {
-      deleter_id_ = id;
-    }
     void set_context(void *ctx)
     {
 
@@ -74,17 +104,15 @@ namespace enigma
     }
 
     // Methods
-    // void clear()
-    // {
-    //   if (deleter_ && data_)
-    //   {
-    //     deleter_(ctx_ ? ctx_ : data_);
-    //   }
-    //   data_ = nullptr;
-    //   ctx_ = nullptr;
-    //   deleter_ = nullptr;
-    //   deleter_id_ = 0;
-    // }
+    // Runs the deleter, leaving an empty DataPtr
+    void clear()
+    {
+      if (deleter_)
+        deleter_(this);
+      data_ = nullptr;
+      ctx_ = nullptr;
+      deleter_ = nullptr;
+    }
 
     void *move_context()
     {
@@ -108,8 +136,8 @@ namespace enigma
 
     void set_deleter(DeleterFn new_deleter)
     {
-      deleter_ = std::move(new_deleter);
+      deleter_ = new_deleter;
     }
   };
 
-} // namespace enigma
\ No newline at end of file
+} // namespace enigma
@@ -13,6 +13,7 @@ namespace enigma
 
   public:
     // Constructors
+    // For CPU devices a non-negative index names a NUMA node, -1 means "any".
     Device();
     Device(DeviceType type, int index = -1);
     explicit Device(const std::string &device_string);
@@ -25,6 +26,7 @@ namespace enigma
     bool has_index() const { return index_ != -1; };
     bool is_cpu() const { return type_ == DeviceType::CPU; };
     bool is_cuda() const { return type_ == DeviceType::CUDA; };
+    bool is_meta() const { return type_ == DeviceType::META; };
 
     std::string to_string() const;
     bool operator==(const Device &other) const = default;
@@ -9,7 +9,11 @@ namespace enigma
   {
     INVALID_TYPE = -1,
     CPU = 0,
-    CUDA
+    CUDA,
+    SIM,         // simulated accelerator: host memory behind a device-style backend
+    META,        // sizes only: Storages on it allocate nothing
+    PRIVATE_USE, // for out-of-tree backends
+    COUNT
   };
 
   std::string device_type_name(DeviceType device_type);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace enigma
+{
+  // Base for objects owned through intrusive_ptr: the reference count lives in
+  // the object itself, so a handle is one pointer and sharing costs no control
+  // block. Objects that never reach an intrusive_ptr (stack, members,
+  // std::shared_ptr) simply leave the count at zero.
+  class intrusive_ptr_target
+  {
+    mutable std::atomic<uint32_t> refcount_{0};
+
+    template <typename T>
+    friend class intrusive_ptr;
+
+  protected:
+    intrusive_ptr_target() = default;
+    // A copied object starts with no owners of its own
+    intrusive_ptr_target(const intrusive_ptr_target &) noexcept {}
+    intrusive_ptr_target &operator=(const intrusive_ptr_target &) noexcept { return *this; }
+    ~intrusive_ptr_target() = default;
+
+  public:
+    uint32_t use_count() const { return refcount_.load(std::memory_order_acquire); }
+  };
+
+  // Shared owning handle to an intrusive_ptr_target. When the last handle goes
+  // away the object is released through T::destroy(T *) if T provides one (to
+  // undo a custom allocation), otherwise with delete.
+  template <typename T>
+  class intrusive_ptr
+  {
+    T *target_ = nullptr;
+
+    void retain()
+    {
+      if (target_)
+        target_->refcount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+      if (target_ && target_->refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        if constexpr (requires(T *target) { T::destroy(target); })
+          T::destroy(target_);
+        else
+          delete target_;
+      }
+      target_ = nullptr;
+    }
+
+  public:
+    intrusive_ptr() = default;
+    intrusive_ptr(std::nullptr_t) {}
+    // Takes a reference on `target`, which may already be shared
+    explicit intrusive_ptr(T *target) : target_(target) { retain(); }
+
+    intrusive_ptr(const intrusive_ptr &other) : target_(other.target_) { retain(); }
+    intrusive_ptr(intrusive_ptr &&other) noexcept : target_(std::exchange(other.target_, nullptr)) {}
+
+    intrusive_ptr &operator=(const intrusive_ptr &other)
+    {
+      intrusive_ptr(other).swap(*this);
+      return *this;
+    }
+    intrusive_ptr &operator=(intrusive_ptr &&other) noexcept
+    {
+      intrusive_ptr(std::move(other)).swap(*this);
+      return *this;
+    }
+
+    ~intrusive_ptr() { release(); }
+
+    T *get() const { return target_; }
+    T &operator*() const { return *target_; }
+    T *operator->() const { return target_; }
+    explicit operator bool() const { return target_ != nullptr; }
+    uint32_t use_count() const { return target_ ? target_->use_count() : 0; }
+
+    void reset() { release(); }
+    void swap(intrusive_ptr &other) noexcept { std::swap(target_, other.target_); }
+
+    bool operator==(const intrusive_ptr &other) const { return target_ == other.target_; }
+    bool operator==(std::nullptr_t) const { return target_ == nullptr; }
+  };
+
+  template <typename T, typename... Args>
+  intrusive_ptr<T> make_intrusive(Args &&...args)
+  {
+    return intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+  }
+
+} // namespace enigma
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "DataPtr.h"
+
+namespace enigma
+{
+  enum class MapMode
+  {
+    ReadOnly, // shared with the page cache, writes fault
+    Private   // copy-on-write: writes stay private to this process
+  };
+
+  enum class MemoryAdvice
+  {
+    Normal,
+    Sequential, // aggressive read-ahead, pages dropped soon after use
+    Random,     // no read-ahead
+    WillNeed    // start paging in now
+  };
+
+  // Maps `length` bytes of `path` starting at `offset` (any alignment; 0 length
+  // maps to the end of the file). The returned DataPtr owns the mapping and
+  // munmaps it when destroyed.
+  DataPtr map_file(const std::string &path, size_t offset, size_t length,
+                   MapMode mode, size_t *mapped_length = nullptr);
+
+  // Whether `data_ptr` owns a ReadOnly mapping from map_file(), whose pages
+  // fault on write
+  bool is_read_only_mapping(const DataPtr &data_ptr);
+
+  // madvise over the pages spanned by [ptr, ptr + num_bytes).
+  void advise_memory(void *ptr, size_t num_bytes, MemoryAdvice advice);
+
+} // namespace enigma
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "Device.h"
+
+namespace enigma
+{
+  struct MemoryStats
+  {
+    // Bucket i counts allocations of (2^(i-1), 2^i] bytes; the last bucket is open ended
+    static constexpr int kHistogramBuckets = 48;
+
+    int64_t current_bytes = 0;    // in use, after allocator rounding
+    int64_t peak_bytes = 0;       // high-water mark of current_bytes
+    int64_t allocation_count = 0;
+    int64_t free_count = 0;
+    int64_t reserved_bytes = 0;   // obtained from the system: in use + cached
+    int64_t cached_bytes = 0;     // reserved but not in use
+    std::array<int64_t, kHistogramBuckets> size_histogram{};
+  };
+
+  // Statistics of `device`. A device without an index aggregates every index of
+  // its type, e.g. Device(DeviceType::CPU) covers all NUMA nodes.
+  //
+  // Counters are kept per thread and only summed here, so recording is a few
+  // uncontended relaxed stores. peak_bytes is tracked from per-thread deltas
+  // flushed every kPeakFlushBytes and may lag the true peak by that much per
+  // thread.
+  MemoryStats memory_stats(const Device &device);
+
+  // Restarts peak tracking from the current usage.
+  void reset_peak_memory_stats(const Device &device);
+
+  namespace stats
+  {
+    constexpr int64_t kPeakFlushBytes = 1 << 20;
+
+    // Hooks for allocators. `num_bytes` is the size actually handed out.
+    void record_allocation(const Device &device, size_t num_bytes);
+    void record_free(const Device &device, size_t num_bytes);
+    // Memory obtained from (positive) or returned to (negative) the system.
+    void record_reserved(const Device &device, int64_t delta);
+  } // namespace stats
+
+} // namespace enigma
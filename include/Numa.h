@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace enigma::numa
+{
+  // Number of NUMA nodes with memory, 1 when the system exposes no topology.
+  int num_nodes();
+
+  // True when there is more than one node, i.e. placement actually matters.
+  bool is_available();
+
+  // Sets the memory policy of [ptr, ptr + num_bytes) to prefer `node`. The range
+  // must be page aligned and should not have been touched yet, so pages get
+  // placed on first touch. No-op when NUMA is unavailable or node < 0.
+  // Returns whether a policy was applied.
+  bool bind_memory(void *ptr, size_t num_bytes, int node);
+
+  // Makes `node` the preferred node for future allocations by the calling
+  // thread (set_mempolicy). Pass -1 to restore the default policy.
+  bool set_preferred_node(int node);
+
+  // Node each page of [ptr, ptr + num_bytes) currently resides on; -1 for pages
+  // that are not resident yet or when the kernel cannot tell.
+  std::vector<int> page_nodes(const void *ptr, size_t num_bytes);
+
+  // Node holding most resident pages of the range, -1 if none are resident.
+  int node_of(const void *ptr, size_t num_bytes);
+
+} // namespace enigma::numa
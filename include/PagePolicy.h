@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+
+namespace enigma
+{
+  constexpr size_t kHugePageSize = 2 << 20;
+
+  enum class Prefault
+  {
+    None,     // pages are faulted in on first touch
+    Populate, // fault every page in at allocation time
+    Lock      // populate and mlock, so pages are never reclaimed or swapped
+  };
+
+  // How large buffers are backed. Allocations of at least huge_page_threshold
+  // bytes get a dedicated, 2 MiB aligned mapping advised with MADV_HUGEPAGE and
+  // are prefaulted according to `prefault`. Disabled by default: huge pages
+  // trade memory and compaction latency for fewer faults and TLB misses.
+  struct PagePolicy
+  {
+    size_t huge_page_threshold = std::numeric_limits<size_t>::max();
+    Prefault prefault = Prefault::None;
+
+    bool applies_to(size_t num_bytes) const { return num_bytes >= huge_page_threshold; }
+  };
+
+  // Asks for transparent huge pages on a fresh mapping; returns whether the
+  // kernel accepted the hint.
+  bool advise_huge_pages(void *ptr, size_t num_bytes);
+
+  // Faults in (and for Prefault::Lock, mlocks) [ptr, ptr + num_bytes). Falls back
+  // to populating when locking is not permitted. Returns whether the requested
+  // mode was fully honoured.
+  bool prefault_pages(void *ptr, size_t num_bytes, Prefault mode);
+
+  // Bytes of [ptr, ptr + num_bytes) currently backed by transparent huge pages,
+  // as reported by /proc/self/smaps (0 when unavailable).
+  size_t huge_page_bytes(const void *ptr, size_t num_bytes);
+
+} // namespace enigma
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <complex>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <type_traits>
 #include "Device.h"
 
@@ -186,61 +188,190 @@ namespace enigma
     template <ScalarType S>
     using scalar_t = typename ScalarToCPPType<S>::type;
 
+    // Fixed-width integer of a given size and signedness
+    template <size_t Bytes, bool Signed>
+    struct FixedWidthInt;
+    template <>
+    struct FixedWidthInt<1, true>
+    {
+        using type = int8_t;
+    };
+    template <>
+    struct FixedWidthInt<2, true>
+    {
+        using type = int16_t;
+    };
+    template <>
+    struct FixedWidthInt<4, true>
+    {
+        using type = int32_t;
+    };
+    template <>
+    struct FixedWidthInt<8, true>
+    {
+        using type = int64_t;
+    };
+    template <>
+    struct FixedWidthInt<1, false>
+    {
+        using type = uint8_t;
+    };
+    template <>
+    struct FixedWidthInt<2, false>
+    {
+        using type = uint16_t;
+    };
+    template <>
+    struct FixedWidthInt<4, false>
+    {
+        using type = uint32_t;
+    };
+    template <>
+    struct FixedWidthInt<8, false>
+    {
+        using type = uint64_t;
+    };
+
+    // Type a Scalar built from a T holds: T itself for the core types, the
+    // fixed-width integer of the same size and signedness for other integers
+    // (char, long long, ...), and double for long double
+    template <typename T>
+    struct ScalarStorage
+    {
+        using type = T;
+    };
+    template <typename T>
+        requires(std::is_integral_v<T> && !std::is_same_v<T, bool>)
+    struct ScalarStorage<T>
+    {
+        using type = typename FixedWidthInt<sizeof(T), std::is_signed_v<T>>::type;
+    };
+    template <>
+    struct ScalarStorage<long double>
+    {
+        using type = double;
+    };
+
+    template <typename T>
+    using scalar_storage_t = typename ScalarStorage<T>::type;
+
     class Scalar
     {
     private:
+        // One member per ScalarType; values are kept in their own type
         union Data
         {
-            int64_t i;
-            uint64_t u;
-            double d;
-            std::complex<double> z;
+            int8_t i8;
+            int16_t i16;
+            int32_t i32;
+            int64_t i64;
+            uint8_t u8;
+            uint16_t u16;
+            uint32_t u32;
+            uint64_t u64;
+            float f32;
+            double f64;
+            std::complex<float> c64;
+            std::complex<double> c128;
             bool b;
-            Data() : d(0.0) {} // Initialize to 0.0 as Float64 is default
+            Data() : f64(0.0) {} // Initialize to 0.0 as Float64 is default
+
+            // Member holding a value of type T, one of the scalar_t types
+            template <typename T>
+            T get() const
+            {
+                if constexpr (std::is_same_v<T, int8_t>)
+                    return i8;
+                else if constexpr (std::is_same_v<T, int16_t>)
+                    return i16;
+                else if constexpr (std::is_same_v<T, int32_t>)
+                    return i32;
+                else if constexpr (std::is_same_v<T, int64_t>)
+                    return i64;
+                else if constexpr (std::is_same_v<T, uint8_t>)
+                    return u8;
+                else if constexpr (std::is_same_v<T, uint16_t>)
+                    return u16;
+                else if constexpr (std::is_same_v<T, uint32_t>)
+                    return u32;
+                else if constexpr (std::is_same_v<T, uint64_t>)
+                    return u64;
+                else if constexpr (std::is_same_v<T, float>)
+                    return f32;
+                else if constexpr (std::is_same_v<T, double>)
+                    return f64;
+                else if constexpr (std::is_same_v<T, std::complex<float>>)
+                    return c64;
+                else if constexpr (std::is_same_v<T, std::complex<double>>)
+                    return c128;
+                else
+                {
+                    static_assert(std::is_same_v<T, bool>, "not a Scalar storage type");
+                    return b;
+                }
+            }
+
+            template <typename T>
+            void set(T value)
+            {
+                if constexpr (std::is_same_v<T, int8_t>)
+                    i8 = value;
+                else if constexpr (std::is_same_v<T, int16_t>)
+                    i16 = value;
+                else if constexpr (std::is_same_v<T, int32_t>)
+                    i32 = value;
+                else if constexpr (std::is_same_v<T, int64_t>)
+                    i64 = value;
+                else if constexpr (std::is_same_v<T, uint8_t>)
+                    u8 = value;
+                else if constexpr (std::is_same_v<T, uint16_t>)
+                    u16 = value;
+                else if constexpr (std::is_same_v<T, uint32_t>)
+                    u32 = value;
+                else if constexpr (std::is_same_v<T, uint64_t>)
+                    u64 = value;
+                else if constexpr (std::is_same_v<T, float>)
+                    f32 = value;
+                else if constexpr (std::is_same_v<T, double>)
+                    f64 = value;
+                else if constexpr (std::is_same_v<T, std::complex<float>>)
+                    c64 = value;
+                else if constexpr (std::is_same_v<T, std::complex<double>>)
+                    c128 = value;
+                else
+                {
+                    static_assert(std::is_same_v<T, bool>, "not a Scalar storage type");
+                    b = value;
+                }
+            }
         };
 
         ScalarType type_;
         Data data_;
         Device device_;
 
+        // Table of binary operator kernels, which read data_ directly
+        friend struct ScalarDispatch;
+
     public:
         Scalar() : type_(ScalarType::Float64), device_(DeviceType::CPU) {}
 
         // Type-specific constructors
-        explicit Scalar(double v) : type_(ScalarType::Float64), device_(DeviceType::CPU) { data_.d = v; }
-        explicit Scalar(int64_t v) : type_(ScalarType::Int64), device_(DeviceType::CPU) { data_.i = v; }
-        explicit Scalar(uint64_t v) : type_(ScalarType::UInt64), device_(DeviceType::CPU) { data_.u = v; }
+        explicit Scalar(double v) : type_(ScalarType::Float64), device_(DeviceType::CPU) { data_.f64 = v; }
+        explicit Scalar(int64_t v) : type_(ScalarType::Int64), device_(DeviceType::CPU) { data_.i64 = v; }
+        explicit Scalar(uint64_t v) : type_(ScalarType::UInt64), device_(DeviceType::CPU) { data_.u64 = v; }
         explicit Scalar(bool v) : type_(ScalarType::Bool), device_(DeviceType::CPU) { data_.b = v; }
-        explicit Scalar(const std::complex<double> &v) : type_(ScalarType::Complex128), device_(DeviceType::CPU) { data_.z = v; }
+        explicit Scalar(const std::complex<double> &v) : type_(ScalarType::Complex128), device_(DeviceType::CPU) { data_.c128 = v; }
 
-        // Template constructor for other numeric types
+        // Template constructor for other numeric types. The value keeps its
+        // width: Scalar(1.5f) is Float32 and Scalar(int8_t(3)) is Int8.
         template <typename T,
                   typename = std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, std::complex<float>>>>
         explicit Scalar(T value) : device_(DeviceType::CPU)
         {
-            type_ = CPPTypeToScalar<T>::value;
-            if constexpr (std::is_floating_point_v<T>)
-            {
-                data_.d = static_cast<double>(value);
-                type_ = ScalarType::Float64;
-            }
-            else if constexpr (std::is_integral_v<T>)
-            {
-                if constexpr (std::is_unsigned_v<T>)
-                {
-                    data_.u = static_cast<uint64_t>(value);
-                    type_ = ScalarType::UInt64;
-                }
-                else
-                {
-                    data_.i = static_cast<int64_t>(value);
-                    type_ = ScalarType::Int64;
-                }
-            }
-            else if constexpr (std::is_same_v<T, std::complex<float>>)
-            {
-                data_.z = static_cast<std::complex<double>>(value);
-            }
+            using S = scalar_storage_t<T>;
+            type_ = CPPTypeToScalar<S>::value;
+            data_.set<S>(static_cast<S>(value));
         }
 
         bool isFloatingPoint() const
@@ -266,10 +397,17 @@ namespace enigma
         ScalarType type() const { return type_; }
         Device device() const { return device_; }
 
+        // Value as T, one of the scalar_t types. Throws ScalarTypeError when it
+        // does not fit: out of range, a fraction for an integer, or an
+        // imaginary part for a real type.
         template <typename T>
         T to() const;
 
         Scalar operator-() const;
+        // Computed in, and returning, promoteTypes(type(), other.type()): two
+        // Float32s give a Float32. Integer overflow, and operands that do not
+        // fit the promoted type, throw ScalarTypeError. Division of integers
+        // stays integral when exact and gives a Float64 otherwise.
         Scalar operator+(const Scalar &other) const;
         Scalar operator-(const Scalar &other) const;
         Scalar operator*(const Scalar &other) const;
@@ -282,6 +420,10 @@ namespace enigma
         static std::string typeName(ScalarType type);
         static bool canCast(ScalarType from, ScalarType to);
 
+        // Same value as `type`; throws ScalarTypeError when it does not fit,
+        // like to<T>()
+        Scalar to(ScalarType type) const;
+
         // Device movement (for future CUDA support)
         Scalar to(Device device) const;
 
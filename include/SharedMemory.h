@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "Allocator.h"
+#include "Device.h"
+
+namespace enigma
+{
+  // Allocator whose blocks live in shared memory objects (memfd, or shm_open
+  // where memfd is unavailable) so other processes can map them zero-copy.
+  //
+  // Each block is its own object: one header page followed by the data, which
+  // is therefore page aligned. The header carries a cross-process reference
+  // count of live mappings; the last process to unmap a named object unlinks
+  // it. memfd objects are anonymous and vanish with their last descriptor.
+  class SharedMemoryAllocator : public Allocator
+  {
+  public:
+    SharedMemoryAllocator() = default;
+    ~SharedMemoryAllocator() override;
+
+    void *allocate(size_t num_bytes, size_t alignment = kDefaultAlignment) override;
+    void deallocate(void *ptr) override;
+    Device device() const override { return Device(DeviceType::CPU); }
+
+    // Descriptor of the object backing `ptr`, owned by this allocator; -1 if
+    // `ptr` is not a block of this allocator. dup() it to outlive the block.
+    int fd_of(const void *ptr) const;
+
+    // Maps `num_bytes` of an object created by allocate(), possibly in another
+    // process. `fd` is duplicated, the caller keeps ownership of it. The
+    // returned block is released with deallocate() like any other.
+    void *import(int fd, size_t num_bytes);
+
+  private:
+    struct Mapping
+    {
+      int fd;
+      void *base; // header page
+      size_t length;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<const void *, Mapping> mappings_; // keyed by data pointer
+
+    void *attach(int fd, size_t length);
+    void release(const Mapping &mapping);
+  };
+
+  // Process-wide shared memory allocator.
+  std::shared_ptr<SharedMemoryAllocator> get_shared_memory_allocator();
+
+} // namespace enigma
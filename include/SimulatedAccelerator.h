@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Backend.h"
+#include "CachingAllocator.h"
+
+namespace enigma
+{
+  // Backend for DeviceType::SIM: device memory is host memory from a pool of
+  // its own, and transfers run on a dedicated copy thread, optionally
+  // throttled to a link bandwidth and latency. Good enough to build and
+  // measure transfer overlap and placement logic without an accelerator.
+  class SimulatedAccelerator : public Backend
+  {
+  public:
+    SimulatedAccelerator();
+    ~SimulatedAccelerator() override;
+
+    DeviceType type() const override { return DeviceType::SIM; }
+    std::shared_ptr<Allocator> allocator(const Device &device) override;
+
+    void copy(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+              size_t num_bytes) override;
+    CopyTicket copy_async(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+                          size_t num_bytes) override;
+    bool is_complete(CopyTicket ticket) const override;
+    void wait(CopyTicket ticket) override;
+    void synchronize() override;
+
+    // Simulated link: each copy takes at least latency + bytes / bandwidth.
+    // 0 bytes per second means unthrottled.
+    void set_link(double bytes_per_second, std::chrono::nanoseconds latency = std::chrono::nanoseconds(0));
+
+  private:
+    struct Transfer
+    {
+      void *dst;
+      const void *src;
+      size_t num_bytes;
+      CopyTicket ticket;
+    };
+
+    std::shared_ptr<CachingAllocator> allocator_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queued_;
+    mutable std::condition_variable completed_;
+    std::deque<Transfer> queue_;
+    CopyTicket last_ticket_ = 0;
+    CopyTicket completed_ticket_ = 0;
+    double bytes_per_second_ = 0;
+    std::chrono::nanoseconds latency_{0};
+    bool stopping_ = false;
+    std::thread copy_thread_; // started by the first copy
+
+    void run();
+  };
+
+  // The registered SIM backend, to configure its link.
+  SimulatedAccelerator &simulated_accelerator();
+
+} // namespace enigma
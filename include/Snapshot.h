@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Storage.h"
+
+namespace enigma
+{
+  // Immutable version of a set of Storages, made of lazy clones: taking one
+  // copies nothing, and later writes through mutable_data() on the originals
+  // copy the data they touch instead of changing the snapshot. Safe to read
+  // from another thread while training goes on; drop it to release the
+  // shared buffers.
+  class Snapshot
+  {
+  public:
+    struct Entry
+    {
+      StoragePtr storage; // frozen clone; never written
+      uint64_t version;   // Storage::version() of the original when frozen
+      bool changed;       // version differs from the previous snapshot's
+    };
+
+    Snapshot(uint64_t id, std::vector<Entry> entries) : id_(id), entries_(std::move(entries)) {}
+
+    // 1 for the first snapshot of a Snapshotter, then increasing
+    uint64_t id() const { return id_; }
+    size_t size() const { return entries_.size(); }
+    const Entry &operator[](size_t index) const { return entries_.at(index); }
+    size_t num_changed() const;
+
+    // Binary checkpoint: a header, then index, version, size and bytes of each
+    // entry, or only the changed ones.
+    void write(std::ostream &out, bool changed_only = false) const;
+    // Entries of a checkpoint from write(); those left out are null.
+    static std::vector<StoragePtr> read(std::istream &in, size_t *num_entries = nullptr);
+
+  private:
+    uint64_t id_;
+    std::vector<Entry> entries_;
+  };
+
+  // Takes snapshots of a fixed list of Storages in O(#storages). A Storage
+  // whose version() has not moved since the previous snapshot is marked
+  // unchanged, and reuses that snapshot's clone while it is still alive; the
+  // Snapshotter itself does not keep old snapshots around. Used from the
+  // thread writing the Storages.
+  class Snapshotter
+  {
+  public:
+    explicit Snapshotter(std::vector<StoragePtr> storages);
+
+    std::shared_ptr<const Snapshot> snapshot();
+    const std::vector<StoragePtr> &storages() const { return storages_; }
+
+  private:
+    std::vector<StoragePtr> storages_;
+    std::vector<uint64_t> versions_; // at the previous snapshot
+    std::weak_ptr<const Snapshot> previous_;
+    uint64_t next_id_ = 1;
+  };
+
+  // Writes `snapshot` to `path` on a background thread, then releases it so
+  // the originals stop paying for copy-on-write.
+  std::future<void> write_snapshot_async(std::shared_ptr<const Snapshot> snapshot, std::string path,
+                                         bool changed_only = false);
+
+} // namespace enigma
@@ -3,47 +3,212 @@
 #include "DataPtr.h"
 #include "Allocator.h"
 #include "Device.h"
+#include "IntrusivePtr.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 #include <cstddef>
 
 namespace enigma
 {
 
-  class Storage
+  class Storage;
+  using StoragePtr = intrusive_ptr<Storage>;
+
+  class Stream;
+  class StreamState;
+
+  namespace cow
+  {
+    class ChunkedCOW;
+    void materialize_cow_storage(Storage &storage);
+  }
+
+  class Storage : public intrusive_ptr_target
   {
   private:
-    std::unique_ptr<DataPtr> data_ptr_;
+    // Single allocation holding a Storage created by create() followed by its payload
+    struct CoallocatedBlock;
+
+    DataPtr data_ptr_;
     size_t size_bytes_;
+    size_t capacity_bytes_; // bytes allocated behind data() when owns_allocation_
     Device device_;
+    size_t alignment_; // requested alignment for allocations made by this Storage
     std::shared_ptr<Allocator> allocator_;
+    bool owns_allocation_; // data_ptr_ came from allocator_ via allocate()/reallocate()
+    CoallocatedBlock *coallocated_block_ = nullptr; // block this Storage lives in, if any
+    // Holds payloads of up to kInlineBytes, so tiny Storages never touch the allocator
+    alignas(kDefaultAlignment) unsigned char inline_buffer_[64];
+    // Set while this is a chunked COW clone: data_ptr_ is then the private
+    // region, of which only the chunks marked owned hold valid bytes
+    std::unique_ptr<cow::ChunkedCOW> chunks_;
+    // Bumped by every change made through the Storage API; single writer
+    std::atomic<uint64_t> version_{0};
+    // Streams given this Storage's buffers by record_stream()
+    std::vector<std::weak_ptr<StreamState>> stream_uses_;
 
     void allocate();
     void deallocate();
+    void reallocate(size_t new_capacity_bytes);
+    void adopt_allocation(void *ptr);
+    // set_data_ptr() for a buffer of `capacity_bytes` from allocator_, which
+    // this Storage then owns and can grow in place
+    void replace_with_allocation(void *ptr, size_t capacity_bytes);
+    bool owns_buffer() const;
+    bool fits_inline(size_t size_bytes) const;
+    // Forgets streams that no longer exist
+    void drop_expired_streams();
+    // Copies the remaining shared chunks and leaves chunked mode
+    void materialize_chunks();
+    // Leaves shared COW data and read-only mappings, so the buffer can be written
+    void make_writable();
+    void check_range(size_t offset, size_t length) const;
+    void check_has_data() const;
+
+    // Called by StoragePtr when the last handle goes away
+    static void destroy(Storage *storage);
+    friend class intrusive_ptr<Storage>;
+    friend void cow::materialize_cow_storage(Storage &storage);
 
   public:
-    Storage(size_t size_bytes, const Device &device);
+    // Payloads up to this size are placed in the same allocation as the Storage by create()
+    static constexpr size_t kMaxCoallocatedBytes = 1024;
+    // CPU payloads up to this size with default alignment are stored inside the Storage
+    static constexpr size_t kInlineBytes = sizeof(inline_buffer_);
+    // Smallest buffer create_kernel_cow() backs with a memfd
+    static constexpr size_t kMinKernelCOWBytes = 1 << 20;
+    // Default copy granularity of lazy_clone_chunked()
+    static constexpr size_t kCOWChunkBytes = 64 << 10;
+
+    Storage(size_t size_bytes, const Device &device, size_t alignment = kDefaultAlignment);
     Storage(size_t size_bytes, void *data, const Device &device);
     Storage();
     ~Storage();
 
-    void *data() const { return data_ptr_ ? data_ptr_->get() : nullptr; }
+    // Raw pointer to the whole buffer. Writes through it reach every clone
+    // still sharing the data, so write through mutable_data() instead. A
+    // chunked clone has a single buffer only until its first write; after
+    // that this throws std::runtime_error until materialize() is called.
+    void *data() const;
+    // Whole buffer for reading; shared data is returned as is, never copied
+    const void *const_data() const;
+    // Whole buffer for writing. Shared (COW or chunked) data is materialized
+    // first, so writes stay private to this Storage; when it already owns the
+    // buffer, or holds the last COW reference, nothing is copied. A ReadOnly
+    // file mapping is copied into a private allocation first.
+    void *mutable_data();
+    // Bytes [offset, offset + length) for writing: shared data is copied first,
+    // only the touched chunks for a chunked clone
+    void *mutable_data(size_t offset, size_t length);
+    // Bytes [offset, offset + length) for reading, without copying when they
+    // are still shared. Never copies: on a chunked clone, a range spanning
+    // both copied and shared chunks throws std::runtime_error.
+    const void *const_data(size_t offset, size_t length) const;
     size_t size_bytes() const { return size_bytes_; }
+    // Bytes usable without reallocating; size_bytes() for buffers this Storage
+    // cannot resize in place (shared COW data, mapped files, external memory).
+    size_t capacity_bytes() const;
     const Device &device() const { return device_; }
-    DataPtr &data_ptr() const { return *data_ptr_; }
+    // Guaranteed alignment of data(); page_size() or stricter when requested.
+    size_t alignment() const { return alignment_; }
+    DataPtr &data_ptr() { return data_ptr_; }
+    const DataPtr &data_ptr() const { return data_ptr_; }
     std::shared_ptr<Allocator> allocator() const { return allocator_; }
+    // data() points into this Storage's own inline buffer
+    bool is_inline() const { return data_ptr_.get() == inline_buffer_; }
 
     void set_size_bytes(size_t num_bytes) { size_bytes_ = num_bytes; }
 
+    // Changes whenever the contents may have: mutable_data(), resize() and
+    // set_data_ptr() bump it. Writes through the raw data() pointer are not
+    // seen; call bump_version() after them.
+    uint64_t version() const { return version_.load(std::memory_order_relaxed); }
+    void bump_version() { version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    // Marks the buffer as used by work queued on `stream`. From then on, a
+    // buffer this Storage lets go of (on destruction, reallocation or
+    // set_data_ptr()) is only freed once the stream has run the work queued
+    // on it by then, so the allocator cannot hand it out while that work
+    // still touches it. An inline buffer cannot outlive the Storage, so its
+    // payload moves to the allocator here: record the stream before handing
+    // data() of a small Storage to its work.
+    void record_stream(const Stream &stream);
+
+    // NUMA node holding most of this Storage's resident pages, -1 if unknown.
+    int numa_node() const;
+    // Bytes of this Storage the kernel actually backs with transparent huge pages.
+    size_t huge_page_bytes() const;
+
+    // Keeps the first min(old, new) bytes; bytes past the old size are
+    // uninitialized. Capacity grows geometrically, so repeated appends are
+    // amortized O(1), and shrinking never reallocates.
     void resize(size_t new_size_bytes);
+    // Ensures capacity_bytes() >= capacity_bytes without changing the size.
+    void reserve(size_t capacity_bytes);
+    // Gives capacity beyond size_bytes() back to the allocator.
+    void shrink_to_fit();
+
+    // Heap Storage owned through StoragePtr. Small CPU payloads above
+    // kInlineBytes share one allocation with the Storage itself; the block stays
+    // alive while either the Storage or a COW clone of its data does.
+    static StoragePtr create(size_t size_bytes, const Device &device, size_t alignment = kDefaultAlignment);
+
+    // CPU Storage whose lazy clones are MAP_PRIVATE mappings of one memfd: the
+    // kernel copies only the pages a clone, or the original, writes, and
+    // writes never leak between them. Buffers under kMinKernelCOWBytes are
+    // plain Storages cloned through the user-space COW context.
+    static StoragePtr create_kernel_cow(size_t size_bytes);
+
+    // Copy of this Storage on `device`, moved by the device's Backend. A copy
+    // on META only takes the size; META Storages cannot be copied elsewhere.
+    StoragePtr to(const Device &device) const;
+
+    // Storages on DeviceType::META allocate nothing: they keep their size and
+    // alignment and count toward memory_stats(META), so building a model on
+    // META plans its memory without touching any. data() is null there and
+    // the accessors that return data throw.
+    bool is_meta() const { return device_.is_meta(); }
+    // Gives a META Storage a real, uninitialized buffer of size_bytes() on
+    // `device`, in place, so everything holding it sees the result.
+    void materialize_on(const Device &device);
 
     // Methods for COW support
-    static std::shared_ptr<Storage> create_uninitialized(size_t size_bytes, const Device &device);
-    static std::shared_ptr<Storage> lazy_clone(Storage &src);
+    static StoragePtr create_uninitialized(size_t size_bytes, const Device &device, size_t alignment = kDefaultAlignment);
+    static StoragePtr lazy_clone(Storage &src);
+    // Clone whose writes through mutable_data() copy only the chunks they
+    // touch. Small, inline or non-CPU sources get a plain lazy_clone().
+    static StoragePtr lazy_clone_chunked(Storage &src, size_t chunk_bytes = kCOWChunkBytes);
+    bool is_chunked() const { return chunks_ != nullptr; }
+
+    // Zero-copy Storage over `length` bytes of a file (0 = up to the end),
+    // populated by page faults and shared with the page cache. A ReadOnly
+    // mapping is copied by the first mutable_data(), also after a clone
+    // inherits it as the last reference; writes through data() fault. Private
+    // mode allows writes in place that never reach the file.
+    static StoragePtr from_file(const std::string &path, size_t offset = 0, size_t length = 0,
+                                MapMode mode = MapMode::ReadOnly);
+    // Access-pattern hint for the pages backing this Storage
+    void advise(MemoryAdvice advice) const;
+
+    // Moves the data into a shared memory object (once; later calls are free)
+    // and returns its descriptor for another process to pass to
+    // from_shared_handle(), e.g. over a Unix socket or across fork(). The
+    // descriptor is owned by this Storage. Growing past capacity_bytes()
+    // reallocates and detaches it from the other processes.
+    int share_memory();
+    bool is_shared() const;
+    // Zero-copy view of the first `size_bytes` of a shared Storage's object.
+    // Writes are visible to every process mapping it; `fd` stays the caller's.
+    static StoragePtr from_shared_handle(int fd, size_t size_bytes);
     void materialize();
     bool is_cow() const;
 
     // Method to allow setting a new DataPtr
-    void set_data_ptr(std::unique_ptr<DataPtr> new_data_ptr);
+    void set_data_ptr(DataPtr new_data_ptr);
   };
 
 } // namespace enigma
\ No newline at end of file
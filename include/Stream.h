@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Device.h"
+
+namespace enigma
+{
+  class StreamState;
+
+  // Marks a point in a Stream. Completes once the stream has run everything
+  // queued before it was recorded. Copies share the same point; a
+  // default-constructed Event was never recorded and counts as complete.
+  class Event
+  {
+  public:
+    Event() = default;
+
+    bool query() const;
+    // Blocks the calling thread until the event completes
+    void synchronize() const;
+    // Milliseconds between two completed events
+    double elapsed_ms(const Event &end) const;
+
+  private:
+    struct State;
+    std::shared_ptr<State> state_;
+    friend class Stream;
+    friend class StreamState;
+  };
+
+  // Ordered queue of work for a CPU device, served by a thread of its own.
+  // Work on one stream runs in submission order; work on different streams
+  // runs concurrently unless ordered with events. For a CPU device with an
+  // index, the thread prefers that NUMA node for its allocations.
+  //
+  // Buffers handed to queued work must outlive it: call
+  // Storage::record_stream() so a Storage freed early keeps its buffer until
+  // the stream is done with it.
+  class Stream
+  {
+  public:
+    // Throws std::invalid_argument for non-CPU devices
+    explicit Stream(const Device &device = Device(DeviceType::CPU));
+    // Runs whatever is still queued, then stops the thread
+    ~Stream();
+
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+
+    const Device &device() const { return device_; }
+
+    // Queues `work`. An exception it throws is kept and rethrown by the next
+    // synchronize(); later work still runs.
+    void launch(std::function<void()> work);
+    // Event completing after everything queued so far
+    Event record();
+    // Work queued after this waits for `event`, possibly from another stream
+    void wait(const Event &event);
+
+    // True when everything queued so far has finished
+    bool query() const;
+    // Blocks until everything queued so far has finished, then rethrows the
+    // first exception thrown by that work, if any
+    void synchronize();
+
+  private:
+    Device device_;
+    std::shared_ptr<StreamState> state_;
+    friend class Storage;
+  };
+
+  // Keeps `resource` alive until every stream still alive in `streams` has run
+  // all the work queued on it so far, then drops it on the last of them;
+  // right away when none are alive.
+  void release_after_streams(const std::vector<std::weak_ptr<StreamState>> &streams,
+                             std::shared_ptr<void> resource);
+
+} // namespace enigma
@@ -6,6 +6,11 @@ from ._enigma import (
     get_dtype,
     promote_types,
     can_cast,
+    memory_stats,
+    reset_peak_memory_stats,
+    empty_cache,
+    cow_stats,
+    reset_cow_stats,
 )
 
 
@@ -3,6 +3,9 @@
 #include <pybind11/complex.h>
 #include <pybind11/stl.h>
 #include "Scalar.h"
+#include "CachingAllocator.h"
+#include "COW.h"
+#include "MemoryStats.h"
 #include "DEBUG.h"
 
 namespace py = pybind11;
@@ -66,6 +69,43 @@ py::object scalar_to_py(const Scalar &scalar)
     throw py::type_error("Unknown Scalar type");
 }
 
+// None or "cpu" mean every CPU device, "cpu:1" a single NUMA node
+Device py_to_device(const py::object &obj)
+{
+    if (obj.is_none())
+    {
+        return Device(DeviceType::CPU);
+    }
+    return Device(obj.cast<std::string>());
+}
+
+py::dict memory_stats_to_py(const MemoryStats &stats)
+{
+    py::dict result;
+    result["current_bytes"] = stats.current_bytes;
+    result["peak_bytes"] = stats.peak_bytes;
+    result["allocation_count"] = stats.allocation_count;
+    result["free_count"] = stats.free_count;
+    result["reserved_bytes"] = stats.reserved_bytes;
+    result["cached_bytes"] = stats.cached_bytes;
+    result["size_histogram"] = py::cast(std::vector<int64_t>(stats.size_histogram.begin(), stats.size_histogram.end()));
+    return result;
+}
+
+py::dict cow_stats_to_py(const cow::COWStats &stats)
+{
+    py::dict result;
+    result["clones"] = stats.clones;
+    result["live_contexts"] = stats.live_contexts;
+    result["copies"] = stats.copies;
+    result["handoffs"] = stats.handoffs;
+    result["bytes_cloned"] = stats.bytes_cloned;
+    result["bytes_copied"] = stats.bytes_copied;
+    result["bytes_avoided"] = stats.bytes_avoided;
+    result["copy_ns"] = stats.copy_ns;
+    return result;
+}
+
 PYBIND11_MODULE(_enigma, m)
 {
     // Create the module
@@ -98,12 +138,11 @@ PYBIND11_MODULE(_enigma, m)
         .def(py::init<>())
         .def(py::init([](const py::object &value, py::object dtype)
                       {
+            Scalar scalar = py_to_scalar(value);
             if (!dtype.is_none()) {
-                auto scalar_type = dtype.cast<ScalarType>();
-                // TODO: Implement explicit dtype conversion
-                throw py::type_error("Explicit dtype not yet implemented");
+                return scalar.to(dtype.cast<ScalarType>());
             }
-            return py_to_scalar(value); }),
+            return scalar; }),
              py::arg("value"), py::arg("dtype") = py::none())
 
         // Type checking methods
@@ -185,4 +224,17 @@ PYBIND11_MODULE(_enigma, m)
           { return scalar.type(); });
     m.def("promote_types", &Scalar::promoteTypes);
     m.def("can_cast", &Scalar::canCast);
+
+    // Memory management
+    m.def("memory_stats", [](const py::object &device)
+          { return memory_stats_to_py(memory_stats(py_to_device(device))); },
+          py::arg("device") = py::none());
+    m.def("reset_peak_memory_stats", [](const py::object &device)
+          { reset_peak_memory_stats(py_to_device(device)); },
+          py::arg("device") = py::none());
+    m.def("empty_cache", []()
+          { empty_cache(); });
+    m.def("cow_stats", []()
+          { return cow_stats_to_py(cow::cow_stats()); });
+    m.def("reset_cow_stats", &cow::reset_cow_stats);
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+# python/tests/test_memory.py
+import enigma
+
+
+class TestMemoryStats:
+    KEYS = {
+        "current_bytes",
+        "peak_bytes",
+        "allocation_count",
+        "free_count",
+        "reserved_bytes",
+        "cached_bytes",
+        "size_histogram",
+    }
+
+    def test_memory_stats_keys(self):
+        """Test that memory_stats reports every counter"""
+        stats = enigma.memory_stats()
+        assert set(stats.keys()) == self.KEYS
+        assert len(stats["size_histogram"]) == 48
+
+    def test_memory_stats_invariants(self):
+        """Test basic relations between the counters"""
+        stats = enigma.memory_stats("cpu")
+        assert stats["current_bytes"] >= 0
+        assert stats["peak_bytes"] >= stats["current_bytes"]
+        assert stats["cached_bytes"] >= 0
+        assert stats["allocation_count"] >= stats["free_count"]
+
+    def test_device_argument(self):
+        """Test per-node queries"""
+        stats = enigma.memory_stats("cpu:0")
+        assert stats["current_bytes"] >= 0
+
+    def test_empty_cache_and_peak_reset(self):
+        """Test cache and peak management calls"""
+        enigma.empty_cache()
+        enigma.reset_peak_memory_stats()
+        stats = enigma.memory_stats()
+        assert stats["peak_bytes"] >= stats["current_bytes"]
+
+
+class TestCOWStats:
+    KEYS = {
+        "clones",
+        "live_contexts",
+        "copies",
+        "handoffs",
+        "bytes_cloned",
+        "bytes_copied",
+        "bytes_avoided",
+        "copy_ns",
+    }
+
+    def test_cow_stats_keys(self):
+        """Test that cow_stats reports every counter"""
+        stats = enigma.cow_stats()
+        assert set(stats.keys()) == self.KEYS
+
+    def test_reset_cow_stats(self):
+        """Test that resetting clears the counters but not the live gauge"""
+        enigma.reset_cow_stats()
+        stats = enigma.cow_stats()
+        assert stats["clones"] == 0
+        assert stats["bytes_copied"] == 0
+        assert stats["live_contexts"] >= 0
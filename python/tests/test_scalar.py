@@ -40,6 +40,16 @@ class TestScalar:
         s4 = enigma.Scalar(1.0 + 2.0j)
         assert s4.dtype == enigma.complex128
 
+    def test_explicit_dtype(self):
+        """Test construction with an explicit dtype"""
+        f = enigma.Scalar(1.5, dtype=enigma.float32)
+        assert f.dtype == enigma.float32
+        assert (f + f).dtype == enigma.float32
+        assert (f * enigma.Scalar(2, dtype=enigma.int8)).dtype == enigma.float32
+
+        with pytest.raises(enigma.ScalarTypeError):
+            enigma.Scalar(300, dtype=enigma.int8)
+
     def test_type_checking(self):
         """Test type checking methods"""
         i = enigma.Scalar(42)
@@ -1,41 +1,105 @@
+#include <algorithm>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
+#include <malloc.h>
+#include <unistd.h>
 #include "Allocator.h"
+#include "Arena.h"
+#include "Backend.h"
+#include "CopyEngine.h"
+#include "DataPtr.h"
+#include "MemoryStats.h"
 #include "DEBUG.h"
 
 namespace enigma
 {
-  void *CPUAllocator::allocate(size_t num_bytes)
+  size_t page_size()
   {
-    void *ptr = std::malloc(num_bytes);
-    if (ptr == nullptr)
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+  }
+
+  void *Allocator::reallocate(void *ptr, size_t old_bytes, size_t new_bytes, size_t alignment)
+  {
+    void *moved = allocate(new_bytes, alignment);
+    if (ptr != nullptr)
+    {
+      copy_bytes(moved, ptr, std::min(old_bytes, new_bytes));
+      deallocate(ptr);
+    }
+    return moved;
+  }
+
+  void *CPUAllocator::allocate(size_t num_bytes, size_t alignment)
+  {
+    if (!is_valid_alignment(alignment))
+    {
+      throw std::invalid_argument("Alignment must be a power of two");
+    }
+    // posix_memalign additionally wants a multiple of sizeof(void *)
+    alignment = std::max(alignment, sizeof(void *));
+
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, num_bytes) != 0 || ptr == nullptr)
     {
       throw std::bad_alloc();
     }
+    // Uncached: everything obtained from malloc counts as reserved and in use
+    size_t usable = malloc_usable_size(ptr);
+    stats::record_allocation(device(), usable);
+    stats::record_reserved(device(), static_cast<int64_t>(usable));
     return ptr;
   }
 
   void CPUAllocator::deallocate(void *ptr)
   {
-
+    if (ptr == nullptr)
+      return;
+    size_t usable = malloc_usable_size(ptr);
+    stats::record_free(device(), usable);
+    stats::record_reserved(device(), -static_cast<int64_t>(usable));
     std::free(ptr);
   }
 
-  std::shared_ptr<Allocator> get_allocator(const Device &device)
+  void *CPUAllocator::reallocate(void *ptr, size_t old_bytes, size_t new_bytes, size_t alignment)
   {
-    if (device.is_cpu())
-    {
-      return std::make_shared<CPUAllocator>();
-    }
-    else if (device.is_cuda())
+    // realloc only guarantees malloc's own alignment
+    if (ptr == nullptr || alignment > alignof(std::max_align_t))
+      return Allocator::reallocate(ptr, old_bytes, new_bytes, alignment);
+
+    size_t old_usable = malloc_usable_size(ptr);
+    void *moved = std::realloc(ptr, std::max<size_t>(new_bytes, 1));
+    if (moved == nullptr)
     {
-      // return std::make_shared<CUDAAllocator>();
-      throw std::invalid_argument("CUDAAllocator not implemented yet");
+      throw std::bad_alloc();
     }
-    else
+    size_t usable = malloc_usable_size(moved);
+    stats::record_free(device(), old_usable);
+    stats::record_allocation(device(), usable);
+    stats::record_reserved(device(), static_cast<int64_t>(usable) - static_cast<int64_t>(old_usable));
+    return moved;
+  }
+
+  void deallocate_data_ptr(DataPtr *data_ptr)
+  {
+    static_cast<Allocator *>(data_ptr->get_context())->deallocate(data_ptr->get());
+  }
+
+  std::shared_ptr<Allocator> get_allocator(const Device &device)
+  {
+    if (device.is_cpu())
     {
-      throw std::runtime_error("Invalid device type");
+      if (const auto &arena = ArenaScope::current())
+        return arena;
     }
+    return get_device_allocator(device);
+  }
+
+  std::shared_ptr<Allocator> get_device_allocator(const Device &device)
+  {
+    return get_backend(device.type()).allocator(device);
   }
 
 } // namespace enigma
\ No newline at end of file
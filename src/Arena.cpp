@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <stdexcept>
+#include "Arena.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    thread_local std::shared_ptr<ArenaAllocator> current_arena;
+
+    size_t align_up(size_t value, size_t alignment)
+    {
+      return (value + alignment - 1) & ~(alignment - 1);
+    }
+  } // namespace
+
+  ArenaAllocator::ArenaAllocator(Device device, size_t chunk_size)
+      : device_(device), chunk_size_(chunk_size), backing_(get_device_allocator(device))
+  {
+    if (chunk_size_ == 0)
+    {
+      throw std::invalid_argument("Arena chunk size must be positive");
+    }
+  }
+
+  ArenaAllocator::~ArenaAllocator()
+  {
+    release();
+  }
+
+  void *ArenaAllocator::allocate(size_t num_bytes, size_t alignment)
+  {
+    if (!is_valid_alignment(alignment))
+    {
+      throw std::invalid_argument("Alignment must be a power of two");
+    }
+
+    if (current_ < chunks_.size())
+    {
+      Chunk &chunk = chunks_[current_];
+      uintptr_t base = reinterpret_cast<uintptr_t>(chunk.base);
+      size_t start = align_up(base + offset_, alignment) - base;
+      if (start + num_bytes <= chunk.size)
+      {
+        offset_ = start + num_bytes;
+        return chunk.base + start;
+      }
+    }
+
+    next_chunk(num_bytes, alignment);
+    Chunk &chunk = chunks_[current_];
+    uintptr_t base = reinterpret_cast<uintptr_t>(chunk.base);
+    size_t start = align_up(base, alignment) - base;
+    offset_ = start + num_bytes;
+    return chunk.base + start;
+  }
+
+  void ArenaAllocator::next_chunk(size_t num_bytes, size_t alignment)
+  {
+    size_t needed = num_bytes + (alignment > kDefaultAlignment ? alignment : 0);
+    size_t next = chunks_.empty() ? 0 : current_ + 1;
+
+    // Reuse the chunk kept from before the last reset when it is big enough
+    if (next < chunks_.size() && chunks_[next].size >= needed)
+    {
+      current_ = next;
+      offset_ = 0;
+      return;
+    }
+
+    size_t size = std::max(chunk_size_, needed);
+    auto *base = static_cast<char *>(backing_->allocate(size, kDefaultAlignment));
+    chunks_.insert(chunks_.begin() + next, Chunk{base, size});
+    current_ = next;
+    offset_ = 0;
+  }
+
+  void ArenaAllocator::reset(Mark mark)
+  {
+    if (mark.chunk > current_ || (mark.chunk == current_ && mark.offset > offset_))
+    {
+      throw std::invalid_argument("Cannot reset an arena forward");
+    }
+    current_ = mark.chunk;
+    offset_ = mark.offset;
+  }
+
+  void ArenaAllocator::release()
+  {
+    for (const Chunk &chunk : chunks_)
+      backing_->deallocate(chunk.base);
+    chunks_.clear();
+    current_ = 0;
+    offset_ = 0;
+  }
+
+  size_t ArenaAllocator::used_bytes() const
+  {
+    if (chunks_.empty())
+      return 0;
+    size_t used = offset_;
+    for (size_t i = 0; i < current_; i++)
+      used += chunks_[i].size;
+    return used;
+  }
+
+  size_t ArenaAllocator::capacity_bytes() const
+  {
+    size_t capacity = 0;
+    for (const Chunk &chunk : chunks_)
+      capacity += chunk.size;
+    return capacity;
+  }
+
+  ArenaScope::ArenaScope() : ArenaScope([]
+                                        {
+    // Per-thread arena reused by every default scope on this thread
+    thread_local auto thread_arena = std::make_shared<ArenaAllocator>();
+    return thread_arena; }())
+  {
+  }
+
+  ArenaScope::ArenaScope(std::shared_ptr<ArenaAllocator> arena)
+      : arena_(std::move(arena))
+  {
+    if (!arena_)
+    {
+      throw std::invalid_argument("ArenaScope requires an arena");
+    }
+    mark_ = arena_->mark();
+    previous_ = current_arena;
+    current_arena = arena_;
+  }
+
+  ArenaScope::~ArenaScope()
+  {
+    current_arena = std::move(previous_);
+    arena_->reset(mark_);
+  }
+
+  const std::shared_ptr<ArenaAllocator> &ArenaScope::current()
+  {
+    return current_arena;
+  }
+
+} // namespace enigma
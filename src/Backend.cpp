@@ -0,0 +1,158 @@
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Backend.h"
+#include "CachingAllocator.h"
+#include "CopyEngine.h"
+#include "Numa.h"
+#include "SimulatedAccelerator.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    class CPUBackend : public Backend
+    {
+    public:
+      DeviceType type() const override { return DeviceType::CPU; }
+
+      std::shared_ptr<Allocator> allocator(const Device &device) override
+      {
+        // Process-wide singletons, intentionally leaked so Storages with static
+        // lifetime can still free into them during shutdown.
+        static auto *cpu_allocator = new std::shared_ptr<Allocator>(
+            std::make_shared<CachingAllocator>(Device(DeviceType::CPU)));
+
+        // Without NUMA every CPU index shares the unbound allocator
+        if (!device.has_index() || !numa::is_available())
+          return *cpu_allocator;
+
+        static auto *node_allocators = []
+        {
+          auto *allocators = new std::vector<std::shared_ptr<Allocator>>();
+          for (int node = 0; node < numa::num_nodes(); node++)
+            allocators->push_back(std::make_shared<CachingAllocator>(Device(DeviceType::CPU, node)));
+          return allocators;
+        }();
+        if (device.index() >= static_cast<int>(node_allocators->size()))
+        {
+          throw std::invalid_argument("CPU device index " + std::to_string(device.index()) +
+                                      " exceeds the number of NUMA nodes");
+        }
+        return (*node_allocators)[device.index()];
+      }
+
+      void copy(void *dst, const Device &, const void *src, const Device &, size_t num_bytes) override
+      {
+        copy_bytes(dst, src, num_bytes);
+      }
+    };
+
+    // Hands out no memory at all; Storages on META keep only their size
+    class MetaAllocator : public Allocator
+    {
+    public:
+      void *allocate(size_t, size_t) override { return nullptr; }
+      void deallocate(void *) override {}
+      Device device() const override { return Device(DeviceType::META); }
+    };
+
+    class MetaBackend : public Backend
+    {
+    public:
+      DeviceType type() const override { return DeviceType::META; }
+
+      std::shared_ptr<Allocator> allocator(const Device &) override { return allocator_; }
+
+      void copy(void *, const Device &, const void *, const Device &, size_t) override
+      {
+        throw std::runtime_error("Cannot copy data to or from the meta device");
+      }
+
+    private:
+      std::shared_ptr<Allocator> allocator_ = std::make_shared<MetaAllocator>();
+    };
+
+    constexpr size_t kNumTypes = static_cast<size_t>(DeviceType::COUNT);
+
+    // Lookups are lock-free; backends are never unregistered, and the
+    // registry is leaked so they outlive every Storage
+    struct Registry
+    {
+      std::mutex mutex;
+      std::array<std::atomic<Backend *>, kNumTypes> backends{};
+      std::vector<std::unique_ptr<Backend>> owned;
+
+      void add(std::unique_ptr<Backend> backend)
+      {
+        auto index = static_cast<size_t>(backend->type());
+        if (index >= kNumTypes)
+        {
+          throw std::invalid_argument("Invalid device type");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (backends[index].load(std::memory_order_relaxed))
+        {
+          throw std::invalid_argument("A backend is already registered for " + device_type_name(backend->type()));
+        }
+        backends[index].store(backend.get(), std::memory_order_release);
+        owned.push_back(std::move(backend));
+      }
+    };
+
+    Registry &registry()
+    {
+      static auto *registry = []
+      {
+        auto *built_in = new Registry();
+        built_in->add(std::make_unique<CPUBackend>());
+        built_in->add(std::make_unique<SimulatedAccelerator>());
+        built_in->add(std::make_unique<MetaBackend>());
+        return built_in;
+      }();
+      return *registry;
+    }
+
+    Backend *find_backend(DeviceType type)
+    {
+      auto index = static_cast<size_t>(type);
+      return index < kNumTypes ? registry().backends[index].load(std::memory_order_acquire) : nullptr;
+    }
+  } // namespace
+
+  void register_backend(std::unique_ptr<Backend> backend)
+  {
+    if (!backend)
+    {
+      throw std::invalid_argument("Backend cannot be null");
+    }
+    registry().add(std::move(backend));
+  }
+
+  bool has_backend(DeviceType type)
+  {
+    return find_backend(type) != nullptr;
+  }
+
+  Backend &get_backend(DeviceType type)
+  {
+    Backend *backend = find_backend(type);
+    if (!backend)
+    {
+      throw std::invalid_argument("No backend registered for " + device_type_name(type));
+    }
+    return *backend;
+  }
+
+  void copy_between_devices(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+                            size_t num_bytes)
+  {
+    DeviceType type = dst_device.is_cpu() ? src_device.type() : dst_device.type();
+    get_backend(type).copy(dst, dst_device, src, src_device, num_bytes);
+  }
+
+} // namespace enigma
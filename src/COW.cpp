@@ -1,91 +1,353 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <iterator>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "COW.h"
+#include "CopyEngine.h"
 #include "DEBUG.h"
 
 namespace enigma::cow
 {
+  namespace
+  {
+    enum Counter
+    {
+      kClones,
+      kLiveContexts,
+      kCopies,
+      kHandoffs,
+      kBytesCloned,
+      kBytesCopied,
+      kCopyNs,
+      kNumCounters
+    };
+
+    // Threads spread over the shards so clone-heavy threads don't share a line
+    struct alignas(64) StatShard
+    {
+      std::array<std::atomic<int64_t>, kNumCounters> values{};
+    };
+
+    constexpr unsigned kStatShards = 32;
+    StatShard stat_shards[kStatShards];
+
+    void record(Counter counter, int64_t delta)
+    {
+      static std::atomic<unsigned> next_shard{0};
+      thread_local unsigned shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kStatShards;
+      stat_shards[shard].values[counter].fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    void record_copy(size_t num_bytes, std::chrono::steady_clock::time_point start)
+    {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      record(kCopies, 1);
+      record(kBytesCopied, static_cast<int64_t>(num_bytes));
+      record(kCopyNs, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    void record_clone(size_t num_bytes)
+    {
+      record(kClones, 1);
+      record(kBytesCloned, static_cast<int64_t>(num_bytes));
+    }
+  } // namespace
+
+  COWStats cow_stats()
+  {
+    std::array<int64_t, kNumCounters> totals{};
+    for (auto &shard : stat_shards)
+      for (int i = 0; i < kNumCounters; i++)
+        totals[i] += shard.values[i].load(std::memory_order_relaxed);
+
+    COWStats stats;
+    stats.clones = totals[kClones];
+    stats.live_contexts = totals[kLiveContexts];
+    stats.copies = totals[kCopies];
+    stats.handoffs = totals[kHandoffs];
+    stats.bytes_cloned = totals[kBytesCloned];
+    stats.bytes_copied = totals[kBytesCopied];
+    stats.bytes_avoided = std::max<int64_t>(0, totals[kBytesCloned] - totals[kBytesCopied]);
+    stats.copy_ns = totals[kCopyNs];
+    return stats;
+  }
+
+  void reset_cow_stats()
+  {
+    // live_contexts is a gauge, not a counter
+    for (auto &shard : stat_shards)
+      for (int i = 0; i < kNumCounters; i++)
+        if (i != kLiveContexts)
+          shard.values[i].store(0, std::memory_order_relaxed);
+  }
+
 
   COWDeleterContext::COWDeleterContext(void *ctx, DataPtr::DeleterFn deleter)
-      : refcount_(0), original_ctx_(ctx), data_deleter_(std::move(deleter)), state_(State::Active) {}
+      : refcount_(0), original_ctx_(ctx), data_deleter_(deleter)
+  {
+    record(kLiveContexts, 1);
+  }
 
   COWDeleterContext::~COWDeleterContext()
   {
     assert(refcount_.load(std::memory_order_relaxed) == 0);
-    assert(state_.load(std::memory_order_relaxed) == State::PendingDelete);
-    state_.store(State::Deleted, std::memory_order_release);
+    record(kLiveContexts, -1);
   }
 
   void COWDeleterContext::increment_refcount(int cnt = 1)
   {
+    // New references are made from an existing one, which keeps the count above zero
     refcount_.fetch_add(cnt, std::memory_order_relaxed);
   }
 
-  RefCountResult COWDeleterContext::decrement_refcount()
+  bool COWDeleterContext::decrement_refcount()
   {
-    auto prev_count = refcount_.fetch_sub(1, std::memory_order_acq_rel);
-    if (prev_count == 1)
-    {
-      // Last reference
-      std::unique_lock lock(mutex_);
-      state_.store(State::PendingDelete, std::memory_order_release);
-      return original_ctx_;
-    }
-
-    // Still shared - return read lock
-    return std::shared_lock<std::shared_mutex>(mutex_);
+    // Release publishes our writes to the buffer; acquire, which only matters
+    // for the last reference, sees everyone else's before it is freed
+    return refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1;
   }
 
   int64_t COWDeleterContext::reference_count() const
   {
-    ReadGuard guard(mutex_);
     return refcount_.load(std::memory_order_acquire);
   }
 
-  void *COWDeleterContext::get_original_ctx() const
+  bool COWDeleterContext::is_active() const
   {
-    ReadGuard guard(mutex_);
-    return original_ctx_;
+    return refcount_.load(std::memory_order_relaxed) > 0;
   }
 
-  DataPtr::DeleterFn COWDeleterContext::get_original_deleter() const
+  void COWDeleter::deleter(DataPtr *data_ptr)
   {
-    ReadGuard guard(mutex_);
-    return data_deleter_;
+    if (!data_ptr || !data_ptr->get_context())
+      return;
+
+    auto *cow_ctx = static_cast<COWDeleterContext *>(data_ptr->get_context());
+    if (!cow_ctx->decrement_refcount())
+      return;
+
+    void *original_ctx = cow_ctx->get_original_ctx();
+    auto data_deleter = cow_ctx->get_original_deleter();
+    delete cow_ctx;
+    // The original deleter expects its own context back
+    data_ptr->set_context(original_ctx);
+    if (data_deleter)
+      data_deleter(data_ptr);
   }
 
-  bool COWDeleterContext::is_active() const
+  namespace
+  {
+    // ctx holds the mapping length
+    void unmap_region(DataPtr *data_ptr)
+    {
+      munmap(data_ptr->get(), reinterpret_cast<size_t>(data_ptr->get_context()));
+    }
+
+    // memfd shared by the mappings of one kernel-COW buffer
+    struct KernelCOWFile
+    {
+      int fd;
+      size_t length; // of every mapping, whole pages
+      std::atomic<int64_t> refcount{1};
+      std::atomic<bool> frozen{false};
+
+      KernelCOWFile(int fd, size_t length) : fd(fd), length(length) {}
+
+      void release()
+      {
+        if (refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          close(fd);
+          delete this;
+        }
+      }
+    };
+
+    void unmap_kernel_cow(DataPtr *data_ptr)
+    {
+      auto *file = static_cast<KernelCOWFile *>(data_ptr->get_context());
+      munmap(data_ptr->get(), file->length);
+      file->release();
+    }
+
+    void *map_file(KernelCOWFile &file, void *address, int flags)
+    {
+      void *base = mmap(address, file.length, PROT_READ | PROT_WRITE, flags, file.fd, 0);
+      if (base == MAP_FAILED)
+      {
+        throw std::system_error(errno, std::generic_category(), "Cannot map kernel COW buffer");
+      }
+      return base;
+    }
+
+    // Whether a MAP_PRIVATE file mapping has pages the kernel already copied.
+    // Those show up in /proc/self/pagemap as present but not file backed;
+    // swapped-out pages are counted too. Unreadable pagemap counts as yes.
+    bool has_private_pages(const void *data, size_t length)
+    {
+      constexpr uint64_t kPresent = uint64_t{1} << 63;
+      constexpr uint64_t kSwapped = uint64_t{1} << 62;
+      constexpr uint64_t kFilePage = uint64_t{1} << 61;
+
+      int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+      if (pagemap < 0)
+        return true;
+      size_t first = reinterpret_cast<uintptr_t>(data) / page_size();
+      size_t count = length / page_size();
+      uint64_t entries[512];
+      bool found = false;
+      for (size_t done = 0; done < count && !found;)
+      {
+        size_t batch = std::min(count - done, std::size(entries));
+        ssize_t bytes = pread(pagemap, entries, batch * sizeof(uint64_t), static_cast<off_t>((first + done) * sizeof(uint64_t)));
+        if (bytes != static_cast<ssize_t>(batch * sizeof(uint64_t)))
+        {
+          found = true;
+          break;
+        }
+        for (size_t i = 0; i < batch && !found; i++)
+          found = (entries[i] & kSwapped) || ((entries[i] & kPresent) && !(entries[i] & kFilePage));
+        done += batch;
+      }
+      close(pagemap);
+      return found;
+    }
+  } // namespace
+
+  DataPtr make_kernel_cow_data_ptr(size_t size_bytes, const Device &device)
   {
-    return state_.load(std::memory_order_acquire) == State::Active;
+    size_t length = (size_bytes + page_size() - 1) / page_size() * page_size();
+    int fd = memfd_create("enigma_cow", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "Cannot create kernel COW buffer");
+    }
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0)
+    {
+      int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), "Cannot size kernel COW buffer");
+    }
+    auto *file = new KernelCOWFile(fd, length);
+    try
+    {
+      void *data = map_file(*file, nullptr, MAP_SHARED);
+      return DataPtr(data, file, unmap_kernel_cow, device);
+    }
+    catch (...)
+    {
+      file->release();
+      throw;
+    }
   }
 
-  void COWDeleter::deleter(DataPtr *data_ptr)
+  bool is_kernel_cow_data_ptr(const DataPtr &data_ptr)
   {
+    return data_ptr.get_deleter() == &unmap_kernel_cow;
+  }
 
-    if (!data_ptr || !data_ptr->get_context())
-      return;
+  DataPtr clone_kernel_cow_data_ptr(DataPtr &data_ptr)
+  {
+    auto *file = static_cast<KernelCOWFile *>(data_ptr.get_context());
+    if (!file->frozen.load(std::memory_order_acquire))
+    {
+      // Swap the writable shared mapping for a private one of the same bytes
+      map_file(*file, data_ptr.get(), MAP_PRIVATE | MAP_FIXED);
+      file->frozen.store(true, std::memory_order_release);
+    }
+    else if (has_private_pages(data_ptr.get(), file->length))
+    {
+      return DataPtr();
+    }
 
-    auto *cow_ctx = static_cast<COWDeleterContext *>(data_ptr->get_context());
+    void *data = map_file(*file, nullptr, MAP_PRIVATE);
+    file->refcount.fetch_add(1, std::memory_order_relaxed);
+    return DataPtr(data, file, unmap_kernel_cow, data_ptr.device());
+  }
 
-    int64_t current_count = cow_ctx->reference_count();
+  ChunkedCOW::ChunkedCOW(DataPtr source, size_t size_bytes, size_t chunk_bytes)
+      : source_(std::move(source)), size_bytes_(size_bytes), chunk_bytes_(chunk_bytes), num_owned_(0)
+  {
+    if (chunk_bytes == 0 || chunk_bytes % page_size() != 0)
+    {
+      throw std::invalid_argument("COW chunk size must be a multiple of the page size");
+    }
+    owned_.assign((num_chunks() + 63) / 64, 0);
+    record_clone(size_bytes);
+  }
 
-    if (current_count > 0)
+  DataPtr ChunkedCOW::reserve_region(size_t size_bytes, const Device &device)
+  {
+    size_t length = (size_bytes + page_size() - 1) / page_size() * page_size();
+    void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
     {
+      throw std::system_error(errno, std::generic_category(), "Cannot reserve COW region");
+    }
+    return DataPtr(base, reinterpret_cast<void *>(length), unmap_region, device);
+  }
 
-      auto result = cow_ctx->decrement_refcount();
+  size_t ChunkedCOW::num_chunks() const
+  {
+    return (size_bytes_ + chunk_bytes_ - 1) / chunk_bytes_;
+  }
 
-      if (auto *original_ctx = std::get_if<void *>(&result))
-      {
+  size_t ChunkedCOW::end_chunk(size_t offset, size_t length) const
+  {
+    return std::min(num_chunks(), (offset + std::max<size_t>(length, 1) + chunk_bytes_ - 1) / chunk_bytes_);
+  }
 
-        auto data_deleter = cow_ctx->get_original_deleter();
-        delete cow_ctx;
-        data_deleter(data_ptr);
+  bool ChunkedCOW::all_shared(size_t offset, size_t length) const
+  {
+    for (size_t chunk = first_chunk(offset); chunk < end_chunk(offset, length); chunk++)
+      if (is_owned(chunk))
+        return false;
+    return true;
+  }
+
+  bool ChunkedCOW::all_owned(size_t offset, size_t length) const
+  {
+    for (size_t chunk = first_chunk(offset); chunk < end_chunk(offset, length); chunk++)
+      if (!is_owned(chunk))
+        return false;
+    return true;
+  }
+
+  void ChunkedCOW::copy_in(void *region, size_t offset, size_t length)
+  {
+    // Runs of adjacent shared chunks go out as one copy
+    size_t end = end_chunk(offset, length);
+    for (size_t chunk = first_chunk(offset); chunk < end;)
+    {
+      if (is_owned(chunk))
+      {
+        chunk++;
+        continue;
+      }
+      size_t run = chunk;
+      for (; run < end && !is_owned(run); run++)
+      {
+        owned_[run / 64] |= uint64_t{1} << (run % 64);
+        num_owned_++;
       }
+      size_t begin = chunk * chunk_bytes_;
+      size_t bytes = std::min(run * chunk_bytes_, size_bytes_) - begin;
+      auto start = std::chrono::steady_clock::now();
+      copy_bytes(static_cast<char *>(region) + begin, static_cast<const char *>(source_.get()) + begin, bytes);
+      record_copy(bytes, start);
+      chunk = run;
     }
   }
 
   // Helper functions
-  std::unique_ptr<DataPtr> make_cow_data_ptr(DataPtr &src_ptr, COWDeleterContext &ctx)
+  DataPtr make_cow_data_ptr(DataPtr &src_ptr, COWDeleterContext &ctx)
   {
     if (!ctx.is_active())
     {
@@ -93,21 +355,18 @@ namespace enigma::cow
     }
     // also increment the ptr_refcount_
     ctx.increment_refcount();
-    auto new_ptr = std::make_unique<DataPtr>(
+    return DataPtr(
         src_ptr.get(),
         &ctx,
         COWDeleter::deleter,
-        src_ptr.device(),
-        COWDeleter::identifier());
-    return new_ptr;
+        src_ptr.device());
   }
 
-  std::unique_ptr<DataPtr> copy_cow_data_ptr(DataPtr &src_ptr)
+  DataPtr copy_cow_data_ptr(DataPtr &src_ptr)
   {
     if (!is_cow_data_ptr(src_ptr))
     {
       throw std::runtime_error("Must be a COW data ptr to make copy");
-      return nullptr;
     }
 
     auto *ctx = static_cast<COWDeleterContext *>(src_ptr.get_context());
@@ -127,46 +386,59 @@ namespace enigma::cow
 
   bool is_cow_data_ptr(const DataPtr &data_ptr)
   {
-    return (data_ptr.get_deleter_id() != DataPtr::INVALID_DELETER_ID) &&
-           (data_ptr.get_deleter_id() == COWDeleter::identifier());
+    return data_ptr.get_deleter() == &COWDeleter::deleter;
   }
 
-  std::shared_ptr<Storage> lazy_clone_storage(Storage &storage)
+  DataPtr share_cow_data_ptr(DataPtr &data_ptr)
   {
+    if (is_cow_data_ptr(data_ptr))
+      return copy_cow_data_ptr(data_ptr);
 
-    auto &data_ptr = storage.data_ptr();
-    auto new_storage = std::make_shared<Storage>(0, storage.device());
-    if (!is_cow_data_ptr(data_ptr))
-    {
-      // First conversion to COW
-
-      void *original_ctx = data_ptr.get_context();
-      auto original_deleter = data_ptr.get_deleter();
-      void *data = data_ptr.get();
+    // First conversion to COW
+    auto *cow_ctx = new COWDeleterContext(data_ptr.get_context(), data_ptr.get_deleter());
+    cow_ctx->increment_refcount(2); // the original and the new reference
 
-      auto *cow_ctx = new COWDeleterContext(original_ctx, std::move(original_deleter));
-      cow_ctx->increment_refcount(2); // since orig + laxy_clone
+    data_ptr.set_context(cow_ctx);
+    data_ptr.set_deleter(COWDeleter::deleter);
+    return DataPtr(data_ptr.get(), cow_ctx, COWDeleter::deleter, data_ptr.device());
+  }
 
-      // Update original and new storage
-      data_ptr.set_context(cow_ctx);
-      data_ptr.set_deleter(COWDeleter::deleter);
-      data_ptr.set_deleter_id(COWDeleter::identifier());
+  StoragePtr lazy_clone_storage(Storage &storage)
+  {
 
-      new_storage->set_size_bytes(storage.size_bytes());
-      new_storage->set_data_ptr(std::make_unique<DataPtr>(
-          data,    // share same memory location
-          cow_ctx, // Share same context
-          COWDeleter::deleter,
-          storage.device(),
-          COWDeleter::identifier()));
+    auto &data_ptr = storage.data_ptr();
+    if (storage.is_inline())
+    {
+      // Inline bytes die with their Storage and are cheaper to copy than to share
+      auto start = std::chrono::steady_clock::now();
+      auto copy = Storage::create(storage.size_bytes(), storage.device(), storage.alignment());
+      std::memcpy(copy->data(), storage.data(), storage.size_bytes());
+      record_clone(storage.size_bytes());
+      record_copy(storage.size_bytes(), start);
+      return copy;
     }
-    else
+    // Nothing to share; the clone only needs the size
+    if (storage.is_meta())
     {
-      // Already COW, just clone
-      new_storage->set_size_bytes(storage.size_bytes());
-      new_storage->set_data_ptr(copy_cow_data_ptr(data_ptr));
+      record_clone(0);
+      return Storage::create(storage.size_bytes(), storage.device(), storage.alignment());
     }
-
+    // A chunked clone has no single buffer to share until it is complete
+    if (storage.is_chunked())
+      storage.materialize();
+    auto new_storage = Storage::create_uninitialized(storage.size_bytes(), storage.device(), storage.alignment());
+    if (is_kernel_cow_data_ptr(data_ptr))
+    {
+      // Diverged mappings fall back to sharing in user space
+      if (auto clone = clone_kernel_cow_data_ptr(data_ptr))
+      {
+        new_storage->set_data_ptr(std::move(clone));
+        record_clone(storage.size_bytes());
+        return new_storage;
+      }
+    }
+    new_storage->set_data_ptr(share_cow_data_ptr(data_ptr));
+    record_clone(storage.size_bytes());
     return new_storage;
   }
 
@@ -182,45 +454,39 @@ namespace enigma::cow
       throw COWError("Null context during materialization");
     }
 
-    // Prepare new data under lock
-    void *new_data = nullptr;
+    // References are only made from existing ones, so once we hold the last
+    // one nobody can add another: take the buffer back without copying
+    if (ctx->reference_count() == 1)
     {
-      auto result = ctx->decrement_refcount(); // (either void or a lock)
-
-      if (auto *original_ctx = std::get_if<void *>(&result))
+      DataPtr new_data_ptr(
+          data_ptr.get(),
+          ctx->get_original_ctx(),
+          ctx->get_original_deleter(),
+          data_ptr.device());
+      ctx->decrement_refcount();
+      delete ctx;
+      record(kHandoffs, 1);
+      data_ptr.move_context(); // ctx is gone; don't run the COW deleter
+      // A block from our own allocator stays growable; its true size is
+      // unknown here, but size_bytes() of it is certainly ours
+      if (new_data_ptr.get_deleter() == deallocate_data_ptr &&
+          new_data_ptr.get_context() == storage.allocator().get())
       {
-        // Last reference - take ownership
-        auto original_deleter = ctx->get_original_deleter();
-
-        auto new_data_ptr = std::make_unique<DataPtr>(
-            data_ptr.get(),
-            *original_ctx,
-            original_deleter,
-            data_ptr.device());
-        data_ptr.release_context();
-        storage.set_data_ptr(std::move(new_data_ptr));
-        delete ctx; // since this is last reference, so delete the ctx
+        new_data_ptr.move_context();
+        storage.replace_with_allocation(data_ptr.get(), storage.size_bytes());
         return;
       }
+      storage.set_data_ptr(std::move(new_data_ptr));
+      return;
+    }
 
-      // Still shared - make copy under lock
-      [[maybe_unused]] auto &lock = std::get<std::shared_lock<std::shared_mutex>>(result);
-
-      new_data = storage.allocator()->allocate(storage.size_bytes());
-      std::memcpy(new_data, data_ptr.get(), storage.size_bytes());
-    } // Lock is released here
-
-    // Create and set new DataPtr after lock is released
-    data_ptr.release_context();
-    auto new_data_ptr = std::make_unique<DataPtr>(
-        new_data,
-        nullptr,
-        [allocator = storage.allocator()](DataPtr *p)
-        {
-          allocator->deallocate(p->get());
-        },
-        data_ptr.device());
-    storage.set_data_ptr(std::move(new_data_ptr));
+    // Still shared: copy while our reference keeps the buffer alive, then drop
+    // it (possibly as the last owner, if the others left meanwhile)
+    auto start = std::chrono::steady_clock::now();
+    void *new_data = storage.allocator()->allocate(storage.size_bytes(), storage.alignment());
+    copy_bytes(new_data, data_ptr.get(), storage.size_bytes());
+    record_copy(storage.size_bytes(), start);
+    storage.replace_with_allocation(new_data, storage.size_bytes());
   }
 
-} // namespace enigma::cow
\ No newline at end of file
+} // namespace enigma::cow
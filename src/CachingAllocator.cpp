@@ -0,0 +1,787 @@
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <new>
+#include <unordered_set>
+#include <sys/mman.h>
+#include "CachingAllocator.h"
+#include "MemoryStats.h"
+#include "Numa.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    constexpr uint8_t kNotHead = 0xFF;
+    constexpr uint8_t kFreeBit = 0x80;
+    constexpr uint8_t kCachedBit = 0x40; // sitting in a thread cache or remote queue
+    constexpr int kMaxOrder = CachingAllocator::kNumOrders - 1;
+
+    static_assert((CachingAllocator::kMinBlockSize << kMaxOrder) == CachingAllocator::kSegmentSize,
+                  "segment must hold exactly one block of the largest order");
+
+    size_t block_size(int order)
+    {
+      return CachingAllocator::kMinBlockSize << order;
+    }
+
+    uintptr_t segment_key(const void *ptr)
+    {
+      return reinterpret_cast<uintptr_t>(ptr) & ~(CachingAllocator::kSegmentSize - 1);
+    }
+
+    // Allocators alive in this process, checked by exiting threads before they
+    // hand their caches back
+    struct LiveAllocators
+    {
+      std::mutex mutex;
+      std::unordered_set<uint64_t> uids;
+      uint64_t next_uid = 1;
+    };
+
+    LiveAllocators &live_allocators()
+    {
+      static auto *instance = new LiveAllocators();
+      return *instance;
+    }
+
+    // Trivially destructible, so still readable while other thread_locals are
+    // being destroyed and may free memory
+    thread_local bool thread_caches_retired = false;
+
+    // Fresh, untouched mapping aligned to kSegmentSize. Over-maps by one segment
+    // and trims the misaligned head and the tail.
+    void *map_segment(size_t size)
+    {
+      constexpr size_t alignment = CachingAllocator::kSegmentSize;
+      size_t padded = size + alignment;
+      void *raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED)
+        return nullptr;
+
+      uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+      uintptr_t aligned = (start + alignment - 1) & ~(alignment - 1);
+      if (aligned > start)
+        munmap(raw, aligned - start);
+      uintptr_t tail = aligned + size;
+      uintptr_t end = start + padded;
+      if (end > tail)
+        munmap(reinterpret_cast<void *>(tail), end - tail);
+      return reinterpret_cast<void *>(aligned);
+    }
+  } // namespace
+
+  // Every cache the calling thread is bound to, handed back when it exits
+  struct CachingAllocator::ThreadBindings
+  {
+    struct Binding
+    {
+      uint64_t uid;
+      CachingAllocator *allocator;
+      ThreadCache *cache;
+    };
+    std::vector<Binding> bindings;
+
+    ~ThreadBindings()
+    {
+      LiveAllocators &live = live_allocators();
+      std::lock_guard<std::mutex> lock(live.mutex);
+      for (const Binding &binding : bindings)
+      {
+        if (live.uids.count(binding.uid))
+          binding.allocator->retire_thread_cache(binding.cache);
+      }
+      thread_caches_retired = true;
+    }
+  };
+
+  CachingAllocator::CachingAllocator(Device device)
+      : device_(device), numa_node_(device.is_cpu() ? device.index() : -1),
+        huge_page_threshold_(policy_.huge_page_threshold)
+  {
+    LiveAllocators &live = live_allocators();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    uid_ = live.next_uid++;
+    live.uids.insert(uid_);
+  }
+
+  CachingAllocator::~CachingAllocator()
+  {
+    {
+      LiveAllocators &live = live_allocators();
+      std::lock_guard<std::mutex> lock(live.mutex);
+      live.uids.erase(uid_);
+    }
+    for (auto &[key, segment] : segments_)
+    {
+      munmap(segment->base, segment->size);
+      delete segment;
+    }
+    for (auto &leaf : segment_map_)
+      delete leaf.load(std::memory_order_relaxed);
+    for (auto &cache : caches_)
+      delete cache.load(std::memory_order_relaxed);
+    stats::record_reserved(device_, -static_cast<int64_t>(reserved_bytes_));
+  }
+
+  int CachingAllocator::order_for(size_t num_bytes)
+  {
+    if (num_bytes <= kMinBlockSize)
+      return 0;
+    return std::bit_width(num_bytes - 1) - std::countr_zero(kMinBlockSize);
+  }
+
+  size_t CachingAllocator::round_size(size_t num_bytes)
+  {
+    if (num_bytes > kSegmentSize)
+      return (num_bytes + kSegmentSize - 1) & ~(kSegmentSize - 1);
+    return block_size(order_for(num_bytes));
+  }
+
+  int CachingAllocator::magazine_limit(int order)
+  {
+    return static_cast<int>(std::clamp<size_t>(kMagazineBytes / block_size(order), 1, kMagazineCapacity));
+  }
+
+  void *CachingAllocator::allocate(size_t num_bytes, size_t alignment)
+  {
+    if (!is_valid_alignment(alignment) || alignment > kSegmentSize)
+    {
+      throw std::invalid_argument("Alignment must be a power of two no larger than the segment size");
+    }
+    num_bytes = std::max(num_bytes, alignment);
+    int order = order_for(num_bytes);
+
+    ThreadCache *cache = nullptr;
+    if (order < kNumCachedOrders && num_bytes < huge_page_threshold_.load(std::memory_order_relaxed))
+    {
+      cache = thread_cache(true);
+      if (cache)
+      {
+        if (char *block = cached_allocate(cache, order))
+        {
+          stats::record_allocation(device_, block_size(order));
+          return block;
+        }
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (num_bytes > kSegmentSize || policy_.applies_to(num_bytes))
+    {
+      return allocate_large(num_bytes);
+    }
+    char *block = allocate_buddy(order);
+    if (cache)
+    {
+      Segment *segment = segments_.at(segment_key(block));
+      segment->owners[(block - segment->base) / kMinBlockSize] = cache->id;
+    }
+    allocated_bytes_ += block_size(order);
+    stats::record_allocation(device_, block_size(order));
+    return block;
+  }
+
+  void CachingAllocator::deallocate(void *ptr)
+  {
+    if (ptr == nullptr)
+      return;
+
+    Segment *segment = find_segment(ptr);
+    if (segment && !segment->large && cached_free(segment, static_cast<char *>(ptr)))
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = segments_.find(segment_key(ptr));
+    if (it == segments_.end())
+    {
+      throw std::invalid_argument("Pointer was not allocated by this CachingAllocator");
+    }
+    if (it->second->large)
+      free_large(it->second);
+    else
+      free_buddy(it->second, static_cast<char *>(ptr));
+  }
+
+  CachingAllocator::ThreadCache *CachingAllocator::thread_cache(bool bind)
+  {
+    if (thread_caches_retired)
+      return nullptr;
+    thread_local ThreadBindings thread_bindings;
+    auto &bindings = thread_bindings.bindings;
+    for (const auto &binding : bindings)
+    {
+      if (binding.uid == uid_)
+        return binding.cache;
+    }
+    if (!bind)
+      return nullptr;
+
+    ThreadCache *cache = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Adopt a cache left behind by an exited thread, with whatever its remote
+      // queue collected since, before creating a new one
+      for (int i = 0; i < num_caches_ && cache == nullptr; i++)
+      {
+        ThreadCache *candidate = caches_[i].load(std::memory_order_relaxed);
+        if (!candidate->bound)
+          cache = candidate;
+      }
+      if (cache == nullptr)
+      {
+        if (num_caches_ == kMaxThreadCaches)
+          return nullptr;
+        cache = new ThreadCache();
+        cache->id = static_cast<uint16_t>(num_caches_ + 1);
+        caches_[num_caches_++].store(cache, std::memory_order_release);
+      }
+      cache->bound = true;
+    }
+
+    // Forget allocators destroyed since this thread last bound a cache
+    {
+      LiveAllocators &live = live_allocators();
+      std::lock_guard<std::mutex> lock(live.mutex);
+      std::erase_if(bindings, [&](const auto &binding)
+                    { return !live.uids.count(binding.uid); });
+    }
+    bindings.push_back({uid_, this, cache});
+    return cache;
+  }
+
+  char *CachingAllocator::cached_allocate(ThreadCache *cache, int order)
+  {
+    auto &magazine = cache->magazines[order];
+    if (magazine.count == 0)
+    {
+      // Take back everything other threads freed for us in one exchange
+      RemoteBlock *node = cache->remote.exchange(nullptr, std::memory_order_acquire);
+      int64_t drained = 0;
+      while (node)
+      {
+        RemoteBlock *next = node->next;
+        auto &target = cache->magazines[node->order];
+        if (target.count == magazine_limit(node->order))
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          flush_magazine(cache, node->order, magazine_limit(node->order) / 2);
+        }
+        target.blocks[target.count++] = reinterpret_cast<char *>(node);
+        drained += static_cast<int64_t>(block_size(node->order));
+        node = next;
+      }
+      if (drained == 0)
+        return nullptr;
+      cache->remote_bytes.fetch_sub(drained, std::memory_order_relaxed);
+      cache->cached_bytes.store(cache->cached_bytes.load(std::memory_order_relaxed) + drained,
+                                std::memory_order_relaxed);
+      if (magazine.count == 0)
+        return nullptr;
+    }
+
+    char *block = magazine.blocks[--magazine.count];
+    Segment *segment = find_segment(block);
+    segment->tags[(block - segment->base) / kMinBlockSize].fetch_and(~kCachedBit, std::memory_order_relaxed);
+    cache->cached_bytes.store(cache->cached_bytes.load(std::memory_order_relaxed) -
+                                  static_cast<int64_t>(block_size(order)),
+                              std::memory_order_relaxed);
+    return block;
+  }
+
+  bool CachingAllocator::cached_free(Segment *segment, char *ptr)
+  {
+    size_t index = (ptr - segment->base) / kMinBlockSize;
+    uint8_t tag = segment->tags[index].load(std::memory_order_relaxed);
+    if (tag == kNotHead || (tag & (kFreeBit | kCachedBit)))
+    {
+      throw std::invalid_argument("Invalid or double free in CachingAllocator");
+    }
+    int order = tag;
+    uint16_t owner = segment->owners[index];
+    if (order >= kNumCachedOrders || owner == 0)
+      return false;
+
+    ThreadCache *cache = thread_cache(false);
+    segment->tags[index].store(tag | kCachedBit, std::memory_order_relaxed);
+    stats::record_free(device_, block_size(order));
+
+    if (cache && cache->id == owner)
+    {
+      auto &magazine = cache->magazines[order];
+      if (magazine.count == magazine_limit(order))
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_magazine(cache, order, magazine_limit(order) / 2);
+      }
+      magazine.blocks[magazine.count++] = ptr;
+      cache->cached_bytes.store(cache->cached_bytes.load(std::memory_order_relaxed) +
+                                    static_cast<int64_t>(block_size(order)),
+                                std::memory_order_relaxed);
+      return true;
+    }
+
+    // Foreign block: hand it back to its owner's remote queue
+    ThreadCache *target = caches_[owner - 1].load(std::memory_order_acquire);
+    auto *node = reinterpret_cast<RemoteBlock *>(ptr);
+    node->order = order;
+    target->remote_bytes.fetch_add(static_cast<int64_t>(block_size(order)), std::memory_order_relaxed);
+    RemoteBlock *head = target->remote.load(std::memory_order_relaxed);
+    do
+    {
+      node->next = head;
+    } while (!target->remote.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    return true;
+  }
+
+  void CachingAllocator::flush_magazine(ThreadCache *cache, int order, int keep)
+  {
+    auto &magazine = cache->magazines[order];
+    int released = magazine.count - keep;
+    if (released <= 0)
+      return;
+
+    // The oldest blocks go back; the most recently freed ones stay hot
+    for (int i = 0; i < released; i++)
+    {
+      char *block = magazine.blocks[i];
+      Segment *segment = segments_.at(segment_key(block));
+      release_buddy(segment, (block - segment->base) / kMinBlockSize, order);
+    }
+    std::copy(magazine.blocks.begin() + released, magazine.blocks.begin() + magazine.count, magazine.blocks.begin());
+    magazine.count = keep;
+    cache->cached_bytes.store(cache->cached_bytes.load(std::memory_order_relaxed) -
+                                  released * static_cast<int64_t>(block_size(order)),
+                              std::memory_order_relaxed);
+  }
+
+  void CachingAllocator::drain_remote(ThreadCache *cache)
+  {
+    RemoteBlock *node = cache->remote.exchange(nullptr, std::memory_order_acquire);
+    int64_t drained = 0;
+    while (node)
+    {
+      RemoteBlock *next = node->next;
+      int order = node->order;
+      char *block = reinterpret_cast<char *>(node);
+      Segment *segment = segments_.at(segment_key(block));
+      release_buddy(segment, (block - segment->base) / kMinBlockSize, order);
+      drained += static_cast<int64_t>(block_size(order));
+      node = next;
+    }
+    cache->remote_bytes.fetch_sub(drained, std::memory_order_relaxed);
+  }
+
+  void CachingAllocator::reclaim_thread_caches()
+  {
+    // Only the calling thread may touch its own magazines
+    if (ThreadCache *cache = thread_cache(false))
+    {
+      for (int order = 0; order < kNumCachedOrders; order++)
+        flush_magazine(cache, order, 0);
+    }
+    for (int i = 0; i < num_caches_; i++)
+      drain_remote(caches_[i].load(std::memory_order_relaxed));
+  }
+
+  void CachingAllocator::retire_thread_cache(ThreadCache *cache)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int order = 0; order < kNumCachedOrders; order++)
+      flush_magazine(cache, order, 0);
+    drain_remote(cache);
+    cache->bound = false;
+  }
+
+  void *CachingAllocator::reallocate(void *ptr, size_t old_bytes, size_t new_bytes, size_t alignment)
+  {
+    if (ptr == nullptr)
+      return allocate(new_bytes, alignment);
+    if (!is_valid_alignment(alignment) || alignment > kSegmentSize)
+    {
+      throw std::invalid_argument("Alignment must be a power of two no larger than the segment size");
+    }
+    size_t needed = std::max(new_bytes, alignment);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = segments_.find(segment_key(ptr));
+      if (it == segments_.end())
+      {
+        throw std::invalid_argument("Pointer was not allocated by this CachingAllocator");
+      }
+      Segment *segment = it->second;
+      bool wants_large = needed > kSegmentSize || policy_.applies_to(needed);
+
+      if (segment->large && wants_large)
+      {
+        size_t rounded = needed > kSegmentSize ? round_size(needed) : kSegmentSize;
+        if (resize_large(segment, rounded))
+          return segment->base;
+      }
+      else if (!segment->large && !wants_large)
+      {
+        size_t index = (static_cast<char *>(ptr) - segment->base) / kMinBlockSize;
+        uint8_t tag = segment->tags[index].load(std::memory_order_relaxed);
+        if (tag == kNotHead || (tag & (kFreeBit | kCachedBit)))
+        {
+          throw std::invalid_argument("Invalid reallocation in CachingAllocator");
+        }
+
+        int order = tag;
+        int new_order = order_for(needed);
+        if (new_order <= order)
+        {
+          // Still fits: give the unused upper halves back to the free lists
+          allocated_bytes_ -= block_size(order) - block_size(new_order);
+          stats::record_free(device_, block_size(order));
+          stats::record_allocation(device_, block_size(new_order));
+          while (order > new_order)
+          {
+            --order;
+            size_t buddy = index + (size_t{1} << order);
+            segment->tags[buddy].store(kFreeBit | static_cast<uint8_t>(order), std::memory_order_relaxed);
+            push_free(order, segment->base + buddy * kMinBlockSize);
+          }
+          segment->tags[index].store(static_cast<uint8_t>(new_order), std::memory_order_relaxed);
+          return ptr;
+        }
+      }
+    }
+
+    // Crossing between buddy and large blocks, or growing past the size class
+    return Allocator::reallocate(ptr, old_bytes, new_bytes, alignment);
+  }
+
+  void CachingAllocator::push_free(int order, char *block)
+  {
+    auto *node = reinterpret_cast<FreeBlock *>(block);
+    node->prev = nullptr;
+    node->next = free_lists_[order];
+    if (node->next)
+      node->next->prev = node;
+    free_lists_[order] = node;
+  }
+
+  void CachingAllocator::remove_free(int order, char *block)
+  {
+    auto *node = reinterpret_cast<FreeBlock *>(block);
+    if (node->prev)
+      node->prev->next = node->next;
+    else
+      free_lists_[order] = node->next;
+    if (node->next)
+      node->next->prev = node->prev;
+  }
+
+  char *CachingAllocator::pop_free(int order)
+  {
+    FreeBlock *node = free_lists_[order];
+    if (node == nullptr)
+      return nullptr;
+    free_lists_[order] = node->next;
+    if (node->next)
+      node->next->prev = nullptr;
+    return reinterpret_cast<char *>(node);
+  }
+
+  char *CachingAllocator::allocate_buddy(int order)
+  {
+    // Find the smallest non-empty size class that can satisfy the request
+    int found = order;
+    while (found <= kMaxOrder && free_lists_[found] == nullptr)
+      ++found;
+
+    if (found > kMaxOrder)
+    {
+      // Blocks parked in thread caches may coalesce into what we need
+      reclaim_thread_caches();
+      found = order;
+      while (found <= kMaxOrder && free_lists_[found] == nullptr)
+        ++found;
+    }
+
+    char *block;
+    if (found > kMaxOrder)
+    {
+      Segment *segment = new_segment(kSegmentSize, false);
+      block = segment->base;
+      found = kMaxOrder;
+    }
+    else
+    {
+      block = pop_free(found);
+    }
+
+    Segment *segment = segments_.at(segment_key(block));
+    size_t index = (block - segment->base) / kMinBlockSize;
+
+    // Split down to the requested order, returning upper halves to the free lists
+    while (found > order)
+    {
+      --found;
+      size_t buddy = index + (size_t{1} << found);
+      segment->tags[buddy].store(kFreeBit | static_cast<uint8_t>(found), std::memory_order_relaxed);
+      push_free(found, segment->base + buddy * kMinBlockSize);
+    }
+    segment->tags[index].store(static_cast<uint8_t>(order), std::memory_order_relaxed);
+    segment->owners[index] = 0;
+    return block;
+  }
+
+  void CachingAllocator::free_buddy(Segment *segment, char *ptr)
+  {
+    size_t index = (ptr - segment->base) / kMinBlockSize;
+    uint8_t tag = segment->tags[index].load(std::memory_order_relaxed);
+    if (tag == kNotHead || (tag & (kFreeBit | kCachedBit)))
+    {
+      throw std::invalid_argument("Invalid or double free in CachingAllocator");
+    }
+
+    stats::record_free(device_, block_size(tag));
+    release_buddy(segment, index, tag);
+  }
+
+  void CachingAllocator::release_buddy(Segment *segment, size_t index, int order)
+  {
+    allocated_bytes_ -= block_size(order);
+
+    // Coalesce with free buddies as far up as possible
+    while (order < kMaxOrder)
+    {
+      size_t buddy = index ^ (size_t{1} << order);
+      if (segment->tags[buddy].load(std::memory_order_relaxed) != (kFreeBit | static_cast<uint8_t>(order)))
+        break;
+
+      remove_free(order, segment->base + buddy * kMinBlockSize);
+      segment->tags[buddy].store(kNotHead, std::memory_order_relaxed);
+      segment->tags[index].store(kNotHead, std::memory_order_relaxed);
+      index = std::min(index, buddy);
+      ++order;
+    }
+
+    segment->tags[index].store(kFreeBit | static_cast<uint8_t>(order), std::memory_order_relaxed);
+    push_free(order, segment->base + index * kMinBlockSize);
+  }
+
+  void *CachingAllocator::allocate_large(size_t num_bytes)
+  {
+    size_t rounded = num_bytes > kSegmentSize ? round_size(num_bytes) : kSegmentSize;
+    bool wants_huge_pages = policy_.applies_to(num_bytes);
+
+    // Reuse the tightest cached block, as long as it does not waste more than half
+    auto it = free_large_.lower_bound(rounded);
+    if (it != free_large_.end() && it->first <= 2 * rounded)
+    {
+      Segment *segment = it->second;
+      free_large_.erase(it);
+      if (wants_huge_pages && !segment->huge_pages)
+      {
+        // Already faulted in; khugepaged may still collapse it
+        segment->huge_pages = advise_huge_pages(segment->base, segment->size);
+      }
+      allocated_bytes_ += segment->size;
+      stats::record_allocation(device_, segment->size);
+      return segment->base;
+    }
+
+    Segment *segment = new_segment(rounded, true);
+    if (wants_huge_pages)
+    {
+      // Hint first so the prefault below already faults in huge pages
+      segment->huge_pages = advise_huge_pages(segment->base, segment->size);
+      prefault_pages(segment->base, segment->size, policy_.prefault);
+    }
+    allocated_bytes_ += segment->size;
+    stats::record_allocation(device_, segment->size);
+    return segment->base;
+  }
+
+  void CachingAllocator::free_large(Segment *segment)
+  {
+    allocated_bytes_ -= segment->size;
+    stats::record_free(device_, segment->size);
+    free_large_.emplace(segment->size, segment);
+  }
+
+  bool CachingAllocator::resize_large(Segment *segment, size_t new_size)
+  {
+    size_t old_size = segment->size;
+    if (new_size < old_size)
+    {
+      munmap(segment->base + new_size, old_size - new_size);
+    }
+    else if (new_size > old_size)
+    {
+      // Extend into the following address range if it is free, otherwise move the
+      // page table entries to a fresh aligned range: no bytes are copied either way
+      void *base = mremap(segment->base, old_size, new_size, 0);
+      if (base == MAP_FAILED)
+      {
+        void *target = map_segment(new_size);
+        if (target == nullptr)
+          return false;
+        base = mremap(segment->base, old_size, new_size, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+        if (base == MAP_FAILED)
+        {
+          munmap(target, new_size);
+          return false;
+        }
+        index_segment(segment, false);
+        segments_.erase(reinterpret_cast<uintptr_t>(segment->base));
+        segment->base = static_cast<char *>(base);
+        segments_.emplace(reinterpret_cast<uintptr_t>(base), segment);
+        index_segment(segment, true);
+      }
+    }
+
+    segment->size = new_size;
+    reserved_bytes_ = reserved_bytes_ - old_size + new_size;
+    allocated_bytes_ = allocated_bytes_ - old_size + new_size;
+    stats::record_free(device_, old_size);
+    stats::record_allocation(device_, new_size);
+    stats::record_reserved(device_, static_cast<int64_t>(new_size) - static_cast<int64_t>(old_size));
+    return true;
+  }
+
+  CachingAllocator::Segment *CachingAllocator::new_segment(size_t size, bool large)
+  {
+    void *base = map_segment(size);
+    if (base == nullptr)
+    {
+      // Give cached memory back and retry once before failing
+      for (auto &[size_key, segment] : free_large_)
+        release_segment(segment);
+      free_large_.clear();
+      base = map_segment(size);
+      if (base == nullptr)
+        throw std::bad_alloc();
+    }
+    // Pages are untouched, so the policy decides where they land on first touch
+    numa::bind_memory(base, size, numa_node_);
+
+    auto *segment = new Segment{static_cast<char *>(base), size, large, false, {}, {}};
+    if (!large)
+    {
+      constexpr size_t slots = kSegmentSize / kMinBlockSize;
+      segment->tags = std::make_unique<std::atomic<uint8_t>[]>(slots);
+      for (size_t i = 0; i < slots; i++)
+        segment->tags[i].store(kNotHead, std::memory_order_relaxed);
+      segment->owners.assign(slots, 0);
+    }
+    segments_.emplace(reinterpret_cast<uintptr_t>(base), segment);
+    index_segment(segment, true);
+    reserved_bytes_ += size;
+    stats::record_reserved(device_, static_cast<int64_t>(size));
+    return segment;
+  }
+
+  void CachingAllocator::release_segment(Segment *segment)
+  {
+    index_segment(segment, false);
+    segments_.erase(reinterpret_cast<uintptr_t>(segment->base));
+    reserved_bytes_ -= segment->size;
+    stats::record_reserved(device_, -static_cast<int64_t>(segment->size));
+    munmap(segment->base, segment->size);
+    delete segment;
+  }
+
+  void CachingAllocator::index_segment(Segment *segment, bool present)
+  {
+    uintptr_t key = reinterpret_cast<uintptr_t>(segment->base) / kSegmentSize;
+    if (key >> (2 * kRadixBits))
+      return; // beyond 48 bits: found through segments_ under the lock instead
+
+    auto &slot = segment_map_[key >> kRadixBits];
+    SegmentLeaf *leaf = slot.load(std::memory_order_relaxed);
+    if (leaf == nullptr)
+    {
+      leaf = new SegmentLeaf();
+      slot.store(leaf, std::memory_order_release);
+    }
+    leaf->segments[key & ((size_t{1} << kRadixBits) - 1)].store(present ? segment : nullptr, std::memory_order_release);
+  }
+
+  CachingAllocator::Segment *CachingAllocator::find_segment(const void *ptr) const
+  {
+    uintptr_t key = reinterpret_cast<uintptr_t>(ptr) / kSegmentSize;
+    if (key >> (2 * kRadixBits))
+      return nullptr;
+    SegmentLeaf *leaf = segment_map_[key >> kRadixBits].load(std::memory_order_acquire);
+    if (leaf == nullptr)
+      return nullptr;
+    return leaf->segments[key & ((size_t{1} << kRadixBits) - 1)].load(std::memory_order_acquire);
+  }
+
+  void CachingAllocator::empty_cache()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reclaim_thread_caches();
+
+    for (auto &[size, segment] : free_large_)
+      release_segment(segment);
+    free_large_.clear();
+
+    // A segment is unused once it has coalesced back into one max-order block
+    while (char *block = pop_free(kMaxOrder))
+    {
+      release_segment(segments_.at(segment_key(block)));
+    }
+  }
+
+  void CachingAllocator::set_page_policy(const PagePolicy &policy)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    huge_page_threshold_.store(policy.huge_page_threshold, std::memory_order_relaxed);
+  }
+
+  PagePolicy CachingAllocator::page_policy() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_;
+  }
+
+  size_t CachingAllocator::reserved_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reserved_bytes_;
+  }
+
+  size_t CachingAllocator::allocated_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t cached = 0;
+    for (int i = 0; i < num_caches_; i++)
+    {
+      ThreadCache *cache = caches_[i].load(std::memory_order_relaxed);
+      cached += cache->cached_bytes.load(std::memory_order_relaxed) + cache->remote_bytes.load(std::memory_order_relaxed);
+    }
+    return allocated_bytes_ - static_cast<size_t>(cached);
+  }
+
+  void set_page_policy(const Device &device, const PagePolicy &policy)
+  {
+    if (device.has_index())
+    {
+      std::static_pointer_cast<CachingAllocator>(get_device_allocator(device))->set_page_policy(policy);
+      return;
+    }
+    for (int node = -1; node < numa::num_nodes(); node++)
+    {
+      auto allocator = std::static_pointer_cast<CachingAllocator>(get_device_allocator(Device(DeviceType::CPU, node)));
+      allocator->set_page_policy(policy);
+    }
+  }
+
+  void empty_cache()
+  {
+    for (int node = -1; node < numa::num_nodes(); node++)
+    {
+      auto allocator = std::static_pointer_cast<CachingAllocator>(get_device_allocator(Device(DeviceType::CPU, node)));
+      allocator->empty_cache();
+    }
+  }
+
+} // namespace enigma
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "CopyEngine.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENIGMA_STREAMING_STORES 1
+#endif
+
+namespace enigma
+{
+  namespace
+  {
+    constexpr size_t kPieceAlignment = 4096;
+
+    // One copy split into pieces claimed by whichever thread gets there first
+    struct CopyJob
+    {
+      char *dst;
+      const char *src;
+      size_t num_bytes;
+      size_t piece_bytes;
+      size_t num_pieces;
+      bool streaming;
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> done{0};
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+
+    // Bypasses the cache for the stores; the destination is not read back soon
+    void stream_copy(char *dst, const char *src, size_t num_bytes)
+    {
+#ifdef ENIGMA_STREAMING_STORES
+      size_t head = std::min(num_bytes, (16 - reinterpret_cast<uintptr_t>(dst) % 16) % 16);
+      std::memcpy(dst, src, head);
+      dst += head;
+      src += head;
+      num_bytes -= head;
+
+      size_t body = num_bytes / 64 * 64;
+      for (size_t i = 0; i < body; i += 64)
+      {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i), a);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 48), d);
+      }
+      // Streaming stores are weakly ordered; publish them before reporting done
+      _mm_sfence();
+      std::memcpy(dst + body, src + body, num_bytes - body);
+#else
+      std::memcpy(dst, src, num_bytes);
+#endif
+    }
+
+    void run_pieces(CopyJob &job)
+    {
+      for (size_t piece = job.next.fetch_add(1); piece < job.num_pieces; piece = job.next.fetch_add(1))
+      {
+        size_t offset = piece * job.piece_bytes;
+        size_t bytes = std::min(job.piece_bytes, job.num_bytes - offset);
+        if (job.streaming)
+          stream_copy(job.dst + offset, job.src + offset, bytes);
+        else
+          std::memcpy(job.dst + offset, job.src + offset, bytes);
+
+        if (job.done.fetch_add(1, std::memory_order_acq_rel) + 1 == job.num_pieces)
+        {
+          std::lock_guard<std::mutex> lock(job.mutex);
+          job.finished.notify_all();
+        }
+      }
+    }
+
+    // Workers sleep on a queue of jobs; a job is queued once per helper wanted
+    class CopyPool
+    {
+    public:
+      explicit CopyPool(int num_workers) : pid_(getpid())
+      {
+        for (int i = 0; i < num_workers; i++)
+          std::thread([this]
+                      { work(); })
+              .detach();
+      }
+
+      // Workers do not survive fork(); a child copies on its own
+      bool usable() const { return getpid() == pid_; }
+
+      void submit(const std::shared_ptr<CopyJob> &job, int helpers)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          for (int i = 0; i < helpers; i++)
+            queue_.push_back(job);
+        }
+        if (helpers == 1)
+          available_.notify_one();
+        else
+          available_.notify_all();
+      }
+
+    private:
+      pid_t pid_;
+      std::mutex mutex_;
+      std::condition_variable available_;
+      std::deque<std::shared_ptr<CopyJob>> queue_;
+
+      void work()
+      {
+        for (;;)
+        {
+          std::shared_ptr<CopyJob> job;
+          {
+            std::unique_lock<std::mutex> lock(mutex_);
+            available_.wait(lock, [this]
+                            { return !queue_.empty(); });
+            job = std::move(queue_.front());
+            queue_.pop_front();
+          }
+          run_pieces(*job);
+        }
+      }
+    };
+
+    int hardware_threads()
+    {
+      return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    std::atomic<int> &copy_threads_setting()
+    {
+      static std::atomic<int> threads{hardware_threads()};
+      return threads;
+    }
+
+    // Sized for the machine once; set_copy_threads() only limits how many help.
+    // Leaked so copies during static destruction still work.
+    CopyPool &pool()
+    {
+      static auto *pool = new CopyPool(hardware_threads() - 1);
+      return *pool;
+    }
+
+    size_t detect_last_level_cache()
+    {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+      long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+      if (l3 > 0)
+        return static_cast<size_t>(l3);
+#endif
+      // sysfs reports e.g. "32768K"
+      for (int index = 3; index >= 2; index--)
+      {
+        std::ifstream file("/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/size");
+        size_t value = 0;
+        char unit = 0;
+        if (file >> value && value > 0)
+        {
+          file >> unit;
+          return unit == 'M' ? value << 20 : unit == 'K' ? value << 10 : value;
+        }
+      }
+      return size_t{32} << 20;
+    }
+  } // namespace
+
+  size_t last_level_cache_bytes()
+  {
+    static const size_t bytes = detect_last_level_cache();
+    return bytes;
+  }
+
+  int copy_threads()
+  {
+    return copy_threads_setting().load(std::memory_order_relaxed);
+  }
+
+  void set_copy_threads(int num_threads)
+  {
+    if (num_threads < 1)
+    {
+      throw std::invalid_argument("Copy thread count must be at least 1");
+    }
+    copy_threads_setting().store(std::min(num_threads, hardware_threads()), std::memory_order_relaxed);
+  }
+
+  void copy_bytes(void *dst, const void *src, size_t num_bytes)
+  {
+    if (num_bytes < kParallelCopyThreshold)
+    {
+      std::memcpy(dst, src, num_bytes);
+      return;
+    }
+
+    bool streaming = num_bytes > last_level_cache_bytes();
+    int threads = static_cast<int>(std::min<size_t>(copy_threads(), num_bytes / kMinCopyBytesPerThread));
+    if (threads <= 1 || !pool().usable())
+    {
+      if (streaming)
+        stream_copy(static_cast<char *>(dst), static_cast<const char *>(src), num_bytes);
+      else
+        std::memcpy(dst, src, num_bytes);
+      return;
+    }
+
+    // A few pieces per thread evens out threads that start late
+    auto job = std::make_shared<CopyJob>();
+    job->dst = static_cast<char *>(dst);
+    job->src = static_cast<const char *>(src);
+    job->num_bytes = num_bytes;
+    job->piece_bytes = (num_bytes / (4 * threads) + kPieceAlignment - 1) / kPieceAlignment * kPieceAlignment;
+    job->num_pieces = (num_bytes + job->piece_bytes - 1) / job->piece_bytes;
+    job->streaming = streaming;
+
+    pool().submit(job, threads - 1);
+    run_pieces(*job);
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&]
+                       { return job->done.load(std::memory_order_acquire) == job->num_pieces; });
+  }
+
+} // namespace enigma
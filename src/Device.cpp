@@ -6,9 +6,9 @@ namespace enigma
   Device::Device() : type_(DeviceType::INVALID_TYPE), index_(-1) {}
   Device::Device(DeviceType type, int index) : type_(type), index_(index)
   {
-    if (type_ == DeviceType::CPU && index_ != -1 && index_ != 0)
+    if (index_ < -1)
     {
-      throw std::invalid_argument("CPU device index must be -1 or 0");
+      throw std::invalid_argument("Device index must be -1 or a non-negative integer");
     }
     else if (!is_valid_device_type(type_))
     {
@@ -16,24 +16,62 @@ namespace enigma
     }
   }
 
+  namespace
+  {
+    // Index from the ":N" that follows a device name of `prefix_len`
+    // characters; -1 when there is none
+    int parse_index(const std::string &device_string, size_t prefix_len)
+    {
+      if (device_string.length() == prefix_len)
+      {
+        return -1;
+      }
+      if (device_string[prefix_len] != ':' || device_string.length() == prefix_len + 1)
+      {
+        throw std::invalid_argument("Invalid device string");
+      }
+
+      std::string suffix = device_string.substr(prefix_len + 1);
+      size_t consumed = 0;
+      int index = -1;
+      try
+      {
+        index = std::stoi(suffix, &consumed);
+      }
+      catch (const std::logic_error &)
+      {
+        throw std::invalid_argument("Invalid device string");
+      }
+      if (consumed != suffix.length() || index < 0)
+      {
+        throw std::invalid_argument("Invalid device string");
+      }
+      return index;
+    }
+  } // namespace
+
   Device::Device(const std::string &device_string)
   {
     if (device_string.substr(0, 3) == "cpu")
     {
+      // "cpu:N" names NUMA node N, plain "cpu" any node
       type_ = DeviceType::CPU;
-      index_ = 0;
+      index_ = parse_index(device_string, 3);
     }
     else if (device_string.substr(0, 4) == "cuda")
     {
       type_ = DeviceType::CUDA;
-      if (device_string.length() > 5 && device_string[4] == ':')
-      {
-        index_ = std::stoi(device_string.substr(5));
-      }
-      else
-      {
-        index_ = -1;
-      }
+      index_ = parse_index(device_string, 4);
+    }
+    else if (device_string.substr(0, 3) == "sim")
+    {
+      type_ = DeviceType::SIM;
+      index_ = parse_index(device_string, 3);
+    }
+    else if (device_string == "meta")
+    {
+      type_ = DeviceType::META;
+      index_ = -1;
     }
     else
     {
@@ -10,6 +10,12 @@ namespace enigma
         return "CPU";
       case DeviceType::CUDA:
         return "CUDA";
+      case DeviceType::SIM:
+        return "SIM";
+      case DeviceType::META:
+        return "META";
+      case DeviceType::PRIVATE_USE:
+        return "PRIVATE_USE";
       default:
         return "Unknown";
     }
@@ -21,6 +27,9 @@ namespace enigma
     {
         case DeviceType::CPU:
         case DeviceType::CUDA:
+        case DeviceType::SIM:
+        case DeviceType::META:
+        case DeviceType::PRIVATE_USE:
             return true;
         default:
             return false;
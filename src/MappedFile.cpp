@@ -0,0 +1,130 @@
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Allocator.h"
+#include "MappedFile.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    // Page-aligned mapping backing a DataPtr whose data may start mid-page
+    struct MappingContext
+    {
+      void *base;
+      size_t length;
+      bool read_only;
+    };
+
+    void unmap_deleter(DataPtr *data_ptr)
+    {
+      auto *mapping = static_cast<MappingContext *>(data_ptr->get_context());
+      if (mapping == nullptr)
+        return;
+      munmap(mapping->base, mapping->length);
+      delete mapping;
+    }
+
+    // Closes the descriptor on every exit path of map_file
+    struct FileDescriptor
+    {
+      int fd;
+      ~FileDescriptor()
+      {
+        if (fd >= 0)
+          close(fd);
+      }
+    };
+  } // namespace
+
+  DataPtr map_file(const std::string &path, size_t offset, size_t length,
+                   MapMode mode, size_t *mapped_length)
+  {
+    FileDescriptor file{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+    }
+
+    struct stat info;
+    if (fstat(file.fd, &info) != 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "Cannot stat " + path);
+    }
+    size_t file_size = static_cast<size_t>(info.st_size);
+    if (offset > file_size)
+    {
+      throw std::out_of_range("Offset is past the end of " + path);
+    }
+    if (length == 0)
+    {
+      length = file_size - offset;
+    }
+    if (length == 0 || length > file_size - offset)
+    {
+      throw std::out_of_range("Requested range is outside of " + path);
+    }
+
+    // mmap wants a page-aligned file offset
+    size_t map_offset = offset & ~(page_size() - 1);
+    size_t delta = offset - map_offset;
+    size_t map_length = length + delta;
+
+    int prot = mode == MapMode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+    void *base = mmap(nullptr, map_length, prot, MAP_PRIVATE, file.fd, static_cast<off_t>(map_offset));
+    if (base == MAP_FAILED)
+    {
+      throw std::system_error(errno, std::generic_category(), "Cannot mmap " + path);
+    }
+
+    void *data = static_cast<char *>(base) + delta;
+    auto *mapping = new MappingContext{base, map_length, mode == MapMode::ReadOnly};
+    if (mapped_length)
+      *mapped_length = length;
+    return DataPtr(data, mapping, unmap_deleter, Device(DeviceType::CPU));
+  }
+
+  bool is_read_only_mapping(const DataPtr &data_ptr)
+  {
+    if (data_ptr.get_deleter() != unmap_deleter)
+      return false;
+    auto *mapping = static_cast<const MappingContext *>(data_ptr.get_context());
+    return mapping != nullptr && mapping->read_only;
+  }
+
+  void advise_memory(void *ptr, size_t num_bytes, MemoryAdvice advice)
+  {
+    if (ptr == nullptr || num_bytes == 0)
+      return;
+
+    int flag = MADV_NORMAL;
+    switch (advice)
+    {
+    case MemoryAdvice::Normal:
+      flag = MADV_NORMAL;
+      break;
+    case MemoryAdvice::Sequential:
+      flag = MADV_SEQUENTIAL;
+      break;
+    case MemoryAdvice::Random:
+      flag = MADV_RANDOM;
+      break;
+    case MemoryAdvice::WillNeed:
+      flag = MADV_WILLNEED;
+      break;
+    }
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(ptr) & ~(page_size() - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(ptr) + num_bytes;
+    if (madvise(reinterpret_cast<void *>(start), end - start, flag) != 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "madvise failed");
+    }
+  }
+
+} // namespace enigma
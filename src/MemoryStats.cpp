@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <vector>
+#include "MemoryStats.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    constexpr int kIndicesPerType = 17; // device index -1 .. 15, higher indices share the last slot
+    constexpr int kDeviceTypes = 8;
+    constexpr int kNumSlots = kIndicesPerType * kDeviceTypes;
+
+    int slot_of(DeviceType type, int index)
+    {
+      int type_id = static_cast<int>(type);
+      if (type_id < 0 || type_id >= kDeviceTypes)
+        return -1;
+      return type_id * kIndicesPerType + std::clamp(index, -1, kIndicesPerType - 2) + 1;
+    }
+
+    int bucket_of(size_t num_bytes)
+    {
+      if (num_bytes <= 1)
+        return 0;
+      return std::min<int>(std::bit_width(num_bytes - 1), MemoryStats::kHistogramBuckets - 1);
+    }
+
+    // Counters written by a single thread; other threads only read them
+    struct Counters
+    {
+      std::atomic<int64_t> allocated_bytes{0};
+      std::atomic<int64_t> freed_bytes{0};
+      std::atomic<int64_t> allocations{0};
+      std::atomic<int64_t> frees{0};
+      std::array<std::atomic<int64_t>, MemoryStats::kHistogramBuckets> histogram{};
+      int64_t unflushed = 0; // owner thread only
+    };
+
+    // Single-writer increment: no locked read-modify-write needed
+    void bump(std::atomic<int64_t> &counter, int64_t delta)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    struct PeakTracker
+    {
+      std::atomic<int64_t> flushed_current{0};
+      std::atomic<int64_t> peak{0};
+
+      void add(int64_t delta)
+      {
+        int64_t now = flushed_current.fetch_add(delta, std::memory_order_relaxed) + delta;
+        int64_t peak_seen = peak.load(std::memory_order_relaxed);
+        while (now > peak_seen && !peak.compare_exchange_weak(peak_seen, now, std::memory_order_relaxed))
+        {
+        }
+      }
+    };
+
+    struct SlotGlobals
+    {
+      Counters retired; // folded in from exited threads, written with fetch_add
+      PeakTracker peak;
+      std::atomic<int64_t> reserved_bytes{0};
+    };
+
+    struct ThreadStats;
+
+    struct Registry
+    {
+      std::mutex mutex;
+      std::vector<ThreadStats *> threads;
+      std::array<SlotGlobals, kNumSlots> slots;
+      std::array<PeakTracker, kDeviceTypes> type_peaks; // for index-less queries
+    };
+
+    // Leaked so allocations during static destruction can still be recorded
+    Registry &registry()
+    {
+      static auto *instance = new Registry();
+      return *instance;
+    }
+
+    void flush(int slot, int64_t delta)
+    {
+      Registry &reg = registry();
+      reg.slots[slot].peak.add(delta);
+      reg.type_peaks[slot / kIndicesPerType].add(delta);
+    }
+
+    void fold(Counters &into, const Counters &from)
+    {
+      into.allocated_bytes.fetch_add(from.allocated_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      into.freed_bytes.fetch_add(from.freed_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      into.allocations.fetch_add(from.allocations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      into.frees.fetch_add(from.frees.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      for (int i = 0; i < MemoryStats::kHistogramBuckets; i++)
+        into.histogram[i].fetch_add(from.histogram[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // Trivially destructible, so still readable while other thread_locals are
+    // being destroyed and may free memory
+    thread_local bool thread_stats_retired = false;
+
+    struct ThreadStats
+    {
+      std::array<std::atomic<Counters *>, kNumSlots> slots{};
+
+      ThreadStats()
+      {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(this);
+      }
+
+      ~ThreadStats()
+      {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (int slot = 0; slot < kNumSlots; slot++)
+        {
+          Counters *counters = slots[slot].load(std::memory_order_relaxed);
+          if (!counters)
+            continue;
+          fold(reg.slots[slot].retired, *counters);
+          flush(slot, counters->unflushed);
+          delete counters;
+        }
+        reg.threads.erase(std::find(reg.threads.begin(), reg.threads.end(), this));
+        thread_stats_retired = true;
+      }
+
+      Counters &get(int slot)
+      {
+        Counters *counters = slots[slot].load(std::memory_order_relaxed);
+        if (counters == nullptr)
+        {
+          counters = new Counters();
+          slots[slot].store(counters, std::memory_order_release);
+        }
+        return *counters;
+      }
+    };
+
+    // Null once this thread's counters have been retired
+    Counters *thread_counters(int slot)
+    {
+      if (thread_stats_retired)
+        return nullptr;
+      thread_local ThreadStats stats;
+      return &stats.get(slot);
+    }
+
+    void record(const Device &device, size_t num_bytes, bool is_allocation)
+    {
+      int slot = slot_of(device.type(), device.index());
+      if (slot < 0)
+        return;
+
+      int64_t bytes = static_cast<int64_t>(num_bytes);
+      int64_t delta = is_allocation ? bytes : -bytes;
+      Counters *counters = thread_counters(slot);
+      if (counters == nullptr)
+      {
+        // Thread is exiting: go straight to the shared counters
+        Counters &retired = registry().slots[slot].retired;
+        auto &total = is_allocation ? retired.allocated_bytes : retired.freed_bytes;
+        auto &count = is_allocation ? retired.allocations : retired.frees;
+        total.fetch_add(bytes, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        if (is_allocation)
+          retired.histogram[bucket_of(num_bytes)].fetch_add(1, std::memory_order_relaxed);
+        flush(slot, delta);
+        return;
+      }
+
+      if (is_allocation)
+      {
+        bump(counters->allocated_bytes, bytes);
+        bump(counters->allocations, 1);
+        bump(counters->histogram[bucket_of(num_bytes)], 1);
+      }
+      else
+      {
+        bump(counters->freed_bytes, bytes);
+        bump(counters->frees, 1);
+      }
+
+      counters->unflushed += delta;
+      if (counters->unflushed >= stats::kPeakFlushBytes || counters->unflushed <= -stats::kPeakFlushBytes)
+      {
+        flush(slot, counters->unflushed);
+        counters->unflushed = 0;
+      }
+    }
+
+    void accumulate(MemoryStats &result, const Counters &counters)
+    {
+      result.current_bytes += counters.allocated_bytes.load(std::memory_order_relaxed) -
+                              counters.freed_bytes.load(std::memory_order_relaxed);
+      result.allocation_count += counters.allocations.load(std::memory_order_relaxed);
+      result.free_count += counters.frees.load(std::memory_order_relaxed);
+      for (int i = 0; i < MemoryStats::kHistogramBuckets; i++)
+        result.size_histogram[i] += counters.histogram[i].load(std::memory_order_relaxed);
+    }
+
+    // Slots covered by a query for `device`
+    std::pair<int, int> slot_range(const Device &device)
+    {
+      if (device.has_index())
+      {
+        int slot = slot_of(device.type(), device.index());
+        return {slot, slot + 1};
+      }
+      int first = slot_of(device.type(), -1);
+      return {first, first < 0 ? first : first + kIndicesPerType};
+    }
+  } // namespace
+
+  MemoryStats memory_stats(const Device &device)
+  {
+    MemoryStats result;
+    auto [first, last] = slot_range(device);
+    if (first < 0)
+      return result;
+
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (int slot = first; slot < last; slot++)
+    {
+      accumulate(result, reg.slots[slot].retired);
+      result.reserved_bytes += reg.slots[slot].reserved_bytes.load(std::memory_order_relaxed);
+      for (ThreadStats *thread : reg.threads)
+      {
+        if (Counters *counters = thread->slots[slot].load(std::memory_order_acquire))
+          accumulate(result, *counters);
+      }
+    }
+
+    const PeakTracker &peak = device.has_index() ? reg.slots[first].peak : reg.type_peaks[first / kIndicesPerType];
+    result.peak_bytes = std::max(peak.peak.load(std::memory_order_relaxed), result.current_bytes);
+    result.cached_bytes = std::max<int64_t>(result.reserved_bytes - result.current_bytes, 0);
+    return result;
+  }
+
+  void reset_peak_memory_stats(const Device &device)
+  {
+    auto [first, last] = slot_range(device);
+    if (first < 0)
+      return;
+
+    Registry &reg = registry();
+    for (int slot = first; slot < last; slot++)
+    {
+      auto &tracker = reg.slots[slot].peak;
+      tracker.peak.store(tracker.flushed_current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    auto &type_tracker = reg.type_peaks[first / kIndicesPerType];
+    type_tracker.peak.store(type_tracker.flushed_current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  namespace stats
+  {
+    void record_allocation(const Device &device, size_t num_bytes)
+    {
+      record(device, num_bytes, true);
+    }
+
+    void record_free(const Device &device, size_t num_bytes)
+    {
+      record(device, num_bytes, false);
+    }
+
+    void record_reserved(const Device &device, int64_t delta)
+    {
+      int slot = slot_of(device.type(), device.index());
+      if (slot >= 0)
+        registry().slots[slot].reserved_bytes.fetch_add(delta, std::memory_order_relaxed);
+    }
+  } // namespace stats
+
+} // namespace enigma
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include "Allocator.h"
+#include "Numa.h"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace enigma::numa
+{
+  namespace
+  {
+    int detect_num_nodes()
+    {
+      std::error_code ec;
+      int count = 0;
+      for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec))
+      {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+            std::all_of(name.begin() + 4, name.end(), [](unsigned char c)
+                        { return std::isdigit(c) != 0; }))
+        {
+          ++count;
+        }
+      }
+      return std::max(count, 1);
+    }
+
+#ifdef __linux__
+    constexpr size_t kMaskBits = 8 * sizeof(unsigned long);
+#endif
+  } // namespace
+
+  int num_nodes()
+  {
+    static const int nodes = detect_num_nodes();
+    return nodes;
+  }
+
+  bool is_available()
+  {
+    return num_nodes() > 1;
+  }
+
+  bool bind_memory(void *ptr, size_t num_bytes, int node)
+  {
+#ifdef __linux__
+    if (node < 0 || !is_available() || ptr == nullptr || num_bytes == 0)
+      return false;
+    if (node >= num_nodes() || static_cast<size_t>(node) >= kMaskBits)
+      return false;
+
+    // Preferred rather than strict binding: when the node runs out of memory the
+    // kernel falls back to other nodes instead of failing the allocation.
+    unsigned long mask = 1UL << node;
+    long rc = syscall(SYS_mbind, ptr, num_bytes, MPOL_PREFERRED, &mask, kMaskBits, 0);
+    return rc == 0;
+#else
+    (void)ptr;
+    (void)num_bytes;
+    (void)node;
+    return false;
+#endif
+  }
+
+  bool set_preferred_node(int node)
+  {
+#ifdef __linux__
+    if (!is_available())
+      return false;
+    if (node < 0)
+      return syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0) == 0;
+    if (node >= num_nodes() || static_cast<size_t>(node) >= kMaskBits)
+      return false;
+
+    unsigned long mask = 1UL << node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, kMaskBits) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+  }
+
+  std::vector<int> page_nodes(const void *ptr, size_t num_bytes)
+  {
+    if (ptr == nullptr || num_bytes == 0)
+      return {};
+
+    size_t page = page_size();
+    uintptr_t first = reinterpret_cast<uintptr_t>(ptr) & ~(page - 1);
+    uintptr_t last = reinterpret_cast<uintptr_t>(ptr) + num_bytes;
+    size_t count = (last - first + page - 1) / page;
+    std::vector<int> status(count, -1);
+
+#ifdef __linux__
+    std::vector<void *> pages(count);
+    for (size_t i = 0; i < count; i++)
+      pages[i] = reinterpret_cast<void *>(first + i * page);
+
+    // With a null node array move_pages only reports where each page lives
+    if (syscall(SYS_move_pages, 0, count, pages.data(), nullptr, status.data(), 0) != 0)
+      return std::vector<int>(count, -1);
+
+    // Negative entries are errno values (e.g. -ENOENT for untouched pages)
+    for (int &node : status)
+      node = std::max(node, -1);
+#endif
+    return status;
+  }
+
+  int node_of(const void *ptr, size_t num_bytes)
+  {
+    std::vector<int> counts(num_nodes(), 0);
+    for (int node : page_nodes(ptr, num_bytes))
+    {
+      if (node >= 0 && node < static_cast<int>(counts.size()))
+        counts[node]++;
+    }
+    auto best = std::max_element(counts.begin(), counts.end());
+    if (best == counts.end() || *best == 0)
+      return -1;
+    return static_cast<int>(best - counts.begin());
+  }
+
+} // namespace enigma::numa
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include "Allocator.h"
+#include "PagePolicy.h"
+
+namespace enigma
+{
+  bool advise_huge_pages(void *ptr, size_t num_bytes)
+  {
+#ifdef MADV_HUGEPAGE
+    return madvise(ptr, num_bytes, MADV_HUGEPAGE) == 0;
+#else
+    (void)ptr;
+    (void)num_bytes;
+    return false;
+#endif
+  }
+
+  bool prefault_pages(void *ptr, size_t num_bytes, Prefault mode)
+  {
+    if (mode == Prefault::None || ptr == nullptr || num_bytes == 0)
+      return true;
+
+    if (mode == Prefault::Lock && mlock(ptr, num_bytes) == 0)
+      return true;
+
+    // MAP_POPULATE would fault pages in before MADV_HUGEPAGE could apply, so
+    // populate after the hint instead, touching pages when the kernel is too old
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, num_bytes, MADV_POPULATE_WRITE) != 0)
+#endif
+    {
+      auto *bytes = static_cast<volatile char *>(ptr);
+      for (size_t offset = 0; offset < num_bytes; offset += page_size())
+        bytes[offset] = bytes[offset];
+    }
+    return mode == Prefault::Populate;
+  }
+
+  size_t huge_page_bytes(const void *ptr, size_t num_bytes)
+  {
+    std::ifstream smaps("/proc/self/smaps");
+    if (!smaps || ptr == nullptr)
+      return 0;
+
+    uintptr_t begin = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t end = begin + num_bytes;
+    size_t total = 0;
+    size_t overlap = 0; // overlap of the current mapping with the range
+
+    std::string line;
+    while (std::getline(smaps, line))
+    {
+      // Mapping headers look like "7f00...-7f01... rw-p ..."
+      auto dash = line.find('-');
+      auto space = line.find(' ');
+      if (dash != std::string::npos && space != std::string::npos && dash < space &&
+          std::all_of(line.begin(), line.begin() + dash, [](unsigned char c)
+                      { return std::isxdigit(c) != 0; }))
+      {
+        uintptr_t vma_begin = std::stoull(line.substr(0, dash), nullptr, 16);
+        uintptr_t vma_end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+        uintptr_t lo = std::max(begin, vma_begin);
+        uintptr_t hi = std::min(end, vma_end);
+        overlap = hi > lo ? hi - lo : 0;
+        continue;
+      }
+
+      if (overlap > 0 && line.rfind("AnonHugePages:", 0) == 0)
+      {
+        std::istringstream fields(line.substr(14));
+        size_t kilobytes = 0;
+        fields >> kilobytes;
+        total += std::min(kilobytes * 1024, overlap);
+      }
+    }
+    return total;
+  }
+
+} // namespace enigma
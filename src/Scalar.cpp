@@ -1,8 +1,10 @@
+#include <array>
 #include <cmath>
+#include <limits>
 #include <sstream>
 #include <iomanip>
+#include <utility>
 #include "Scalar.h"
-#include <iostream>
 
 namespace enigma
 {
@@ -35,7 +37,7 @@ namespace enigma
                    almost_equal(a.imag(), b.imag(), epsilon);
         }
 
-        bool isIntegralType(ScalarType type)
+        constexpr bool isIntegralType(ScalarType type)
         {
             return type == ScalarType::Int8 || type == ScalarType::Int16 ||
                    type == ScalarType::Int32 || type == ScalarType::Int64 ||
@@ -43,12 +45,12 @@ namespace enigma
                    type == ScalarType::UInt32 || type == ScalarType::UInt64;
         }
 
-        bool isFloatingType(ScalarType type)
+        constexpr bool isFloatingType(ScalarType type)
         {
             return type == ScalarType::Float32 || type == ScalarType::Float64;
         }
 
-        bool isComplexType(ScalarType type)
+        constexpr bool isComplexType(ScalarType type)
         {
             return type == ScalarType::Complex64 || type == ScalarType::Complex128;
         }
@@ -59,7 +61,7 @@ namespace enigma
             return std::fabs(val - std::round(val)) < 1e-7;
         }
 
-        bool isUnsignedType(ScalarType type)
+        constexpr bool isUnsignedType(ScalarType type)
         {
             switch (type)
             {
@@ -73,7 +75,7 @@ namespace enigma
             }
         }
 
-        int getTypeWidth(ScalarType type)
+        constexpr int getTypeWidth(ScalarType type)
         {
             switch (type)
             {
@@ -94,691 +96,448 @@ namespace enigma
             }
         }
 
-        template <typename To, typename From>
-        To safeCast(From value)
+        // Scalar::promoteTypes(), usable at compile time
+        constexpr ScalarType promote(ScalarType a, ScalarType b)
         {
-            if constexpr (std::is_floating_point_v<From> && std::is_integral_v<To>)
+            // Same type, no promotion needed
+            if (a == b)
+                return a;
+
+            // Handle invalid types
+            if (a == ScalarType::Invalid || b == ScalarType::Invalid)
             {
-                if (!isIntegralDouble(value))
-                {
-                    throw ScalarTypeError("Cannot convert non-integer floating point to integral type");
-                }
+                return ScalarType::Invalid;
             }
 
-            if constexpr (std::is_integral_v<To>)
+            // Special handling for boolean
+            if (a == ScalarType::Bool)
+                return b;
+            if (b == ScalarType::Bool)
+                return a;
+
+            // Complex type promotion mirrors the real path: Complex128 only
+            // when either side is double precision
+            if (isComplexType(a) || isComplexType(b))
             {
-                if (value > static_cast<From>(std::numeric_limits<To>::max()) ||
-                    value < static_cast<From>(std::numeric_limits<To>::min()))
+                if (a == ScalarType::Complex128 || b == ScalarType::Complex128 ||
+                    a == ScalarType::Float64 || b == ScalarType::Float64)
                 {
-                    throw ScalarTypeError("Value out of range for target type");
+                    return ScalarType::Complex128;
                 }
+                return ScalarType::Complex64;
             }
 
-            return static_cast<To>(value);
-        }
-
-        bool would_overflow(int64_t a, int64_t b, bool is_addition)
-        {
-            if (is_addition)
-            {
-                if (b > 0 && a > std::numeric_limits<int64_t>::max() - b)
-                    return true;
-                if (b < 0 && a < std::numeric_limits<int64_t>::min() - b)
-                    return true;
-            }
-            else
+            // Floating point promotion
+            if (isFloatingType(a) || isFloatingType(b))
             {
-                if (b < 0 && a > std::numeric_limits<int64_t>::max() + b)
-                    return true;
-                if (b > 0 && a < std::numeric_limits<int64_t>::min() + b)
-                    return true;
+                // If either is Float64, promote to Float64
+                if (a == ScalarType::Float64 || b == ScalarType::Float64)
+                {
+                    return ScalarType::Float64;
+                }
+                return ScalarType::Float32;
             }
-            return false;
-        }
-    } // namespace
 
-    // Type conversion implementations
-    template <>
-    double Scalar::to<double>() const
-    {
-        switch (type_)
-        {
-        case ScalarType::Float64:
-            return data_.d;
-        case ScalarType::Float32:
-            return data_.d;
-        case ScalarType::Int64:
-            return static_cast<double>(data_.i);
-        case ScalarType::UInt64:
-            return static_cast<double>(data_.u);
-        case ScalarType::Bool:
-            return data_.b ? 1.0 : 0.0;
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            if (data_.z.imag() != 0.0)
+            // Integer promotion rules
+            if (isIntegralType(a) && isIntegralType(b))
             {
-                throw ScalarTypeError("Cannot convert complex with non-zero imaginary part to double");
+                bool aUnsigned = isUnsignedType(a);
+                bool bUnsigned = isUnsignedType(b);
+                int aWidth = getTypeWidth(a);
+                int bWidth = getTypeWidth(b);
+
+                // If both unsigned or both signed, use the wider type
+                if (aUnsigned == bUnsigned)
+                {
+                    return (aWidth >= bWidth) ? a : b;
+                }
+
+                // One signed, one unsigned
+                ScalarType unsignedType = aUnsigned ? a : b;
+                ScalarType signedType = aUnsigned ? b : a;
+
+                // If unsigned type is wider or equal, use it
+                if (getTypeWidth(unsignedType) >= getTypeWidth(signedType))
+                {
+                    return unsignedType;
+                }
+
+                // Otherwise the wider signed type holds every value of both
+                return signedType;
             }
-            return data_.z.real();
-        default:
-            throw ScalarTypeError("Unsupported type conversion to double");
+
+            // Default to Float64 for any other combination
+            return ScalarType::Float64;
         }
-    }
 
-    template <>
-    int64_t Scalar::to<int64_t>() const
-    {
-        switch (type_)
+        template <typename T>
+        constexpr bool is_complex_v = false;
+        template <typename T>
+        constexpr bool is_complex_v<std::complex<T>> = true;
+
+        // Checked conversion between two scalar_t types; see Scalar::to<T>()
+        template <typename To, typename From>
+        To convert(From value)
         {
-        case ScalarType::Int64:
-            return data_.i;
-        case ScalarType::UInt64:
-            if (data_.u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+            if constexpr (std::is_same_v<To, From>)
             {
-                throw ScalarTypeError("UInt64 value too large for Int64");
+                return value;
             }
-            return static_cast<int64_t>(data_.u);
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            if (!isIntegralDouble(data_.d))
+            else if constexpr (std::is_same_v<To, bool>)
             {
-                throw ScalarTypeError("Cannot convert non-integer float to int64_t");
+                return value != From(0);
             }
-            return safeCast<int64_t>(data_.d);
-        case ScalarType::Bool:
-            return data_.b ? 1 : 0;
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            if (data_.z.imag() != 0.0)
+            else if constexpr (is_complex_v<From> && !is_complex_v<To>)
             {
-                throw ScalarTypeError("Cannot convert complex with non-zero imaginary part to int64_t");
+                if (value.imag() != 0)
+                {
+                    throw ScalarTypeError("Cannot convert complex with non-zero imaginary part to a real type");
+                }
+                return convert<To>(value.real());
             }
-            return safeCast<int64_t>(data_.z.real());
-        default:
-            throw ScalarTypeError("Unsupported type conversion to int64_t");
-        }
-    }
-    template <>
-    uint64_t Scalar::to<uint64_t>() const
-    {
-        switch (type_)
-        {
-        case ScalarType::UInt64:
-            return data_.u;
-
-        case ScalarType::Int64:
-            if (data_.i < 0)
+            else if constexpr (is_complex_v<To>)
             {
-                throw ScalarTypeError("Cannot convert negative integer to unsigned");
+                if constexpr (is_complex_v<From>)
+                    return To(value);
+                else
+                    return To(convert<typename To::value_type>(value), 0);
             }
-            return static_cast<uint64_t>(data_.i);
-
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            if (!isIntegralDouble(data_.d) || data_.d < 0)
+            else if constexpr (std::is_floating_point_v<To>)
             {
-                throw ScalarTypeError("Cannot convert non-integral or negative float to uint64_t");
+                return static_cast<To>(value);
             }
-            if (data_.d > static_cast<double>(std::numeric_limits<uint64_t>::max()))
+            else if constexpr (std::is_same_v<From, bool>)
             {
-                throw ScalarTypeError("Float value too large for uint64_t");
+                return value ? 1 : 0;
             }
-            return static_cast<uint64_t>(data_.d);
-
-        case ScalarType::Bool:
-            return data_.b ? 1ULL : 0ULL;
-
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            if (data_.z.imag() != 0.0)
+            else if constexpr (std::is_floating_point_v<From>)
             {
-                throw ScalarTypeError("Cannot convert complex with non-zero imaginary part to uint64_t");
+                if (!isIntegralDouble(value))
+                {
+                    throw ScalarTypeError("Cannot convert non-integer floating point to integral type");
+                }
+                // max() + 1 is a power of two, so it is exact in any floating type
+                From rounded = std::round(value);
+                if (rounded < static_cast<From>(std::numeric_limits<To>::min()) ||
+                    rounded >= static_cast<From>(std::numeric_limits<To>::max()) + 1)
+                {
+                    throw ScalarTypeError("Value out of range for target type");
+                }
+                return static_cast<To>(rounded);
             }
-            if (data_.z.real() < 0 || !isIntegralDouble(data_.z.real()))
+            else
             {
-                throw ScalarTypeError("Cannot convert complex to uint64_t");
+                if (!std::in_range<To>(value))
+                {
+                    throw ScalarTypeError("Value out of range for target type");
+                }
+                return static_cast<To>(value);
             }
-            return static_cast<uint64_t>(data_.z.real());
-
-        default:
-            throw ScalarTypeError("Unsupported type conversion to uint64_t");
         }
-    }
 
-    template <>
-    int32_t Scalar::to<int32_t>() const
-    {
-        switch (type_)
+        template <typename A, typename B>
+        bool equal(A a, B b)
         {
-        case ScalarType::Int64:
-            if (data_.i > static_cast<int64_t>(std::numeric_limits<int32_t>::max()) ||
-                data_.i < static_cast<int64_t>(std::numeric_limits<int32_t>::min()))
-            {
-                throw ScalarTypeError("Int64 value out of range for int32");
-            }
-            return static_cast<int32_t>(data_.i);
-        case ScalarType::UInt64:
-            if (data_.u > static_cast<uint64_t>(std::numeric_limits<int32_t>::max()))
+            constexpr bool a_bool = std::is_same_v<A, bool>, b_bool = std::is_same_v<B, bool>;
+            if constexpr (a_bool || b_bool)
             {
-                throw ScalarTypeError("UInt64 value out of range for int32");
+                // Only allow bool == bool, not bool == number
+                if constexpr (a_bool && b_bool)
+                    return a == b;
+                else
+                    return false;
             }
-            return static_cast<int32_t>(data_.u);
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            if (!isIntegralDouble(data_.d))
+            else if constexpr (is_complex_v<A> || is_complex_v<B>)
             {
-                throw ScalarTypeError("Cannot convert non-integer float to int32");
+                return complex_almost_equal(convert<std::complex<double>>(a), convert<std::complex<double>>(b));
             }
-            if (data_.d > static_cast<double>(std::numeric_limits<int32_t>::max()) ||
-                data_.d < static_cast<double>(std::numeric_limits<int32_t>::min()))
+            else if constexpr (std::is_floating_point_v<A> || std::is_floating_point_v<B>)
             {
-                throw ScalarTypeError("Float value out of range for int32");
+                return almost_equal(static_cast<double>(a), static_cast<double>(b));
             }
-            return static_cast<int32_t>(data_.d);
-        case ScalarType::Bool:
-            return data_.b ? 1 : 0;
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            if (data_.z.imag() != 0.0)
+            else
             {
-                throw ScalarTypeError("Cannot convert complex with non-zero imaginary part to int32");
+                return std::cmp_equal(a, b);
             }
-            return to<int32_t>(); // Convert the real part
-        default:
-            throw ScalarTypeError("Unsupported type conversion to int32");
         }
-    }
+    } // namespace
 
-    template <>
-    bool Scalar::to<bool>() const
+    // Binary arithmetic is a lookup in a table holding one kernel per
+    // (lhs type, rhs type, op), generated at compile time. Each kernel reads
+    // both values straight from the union and has its promotion fixed by its
+    // template arguments, so an operator costs one indirect call and no
+    // further switches on the types.
+    struct ScalarDispatch
     {
-        switch (type_)
+        enum class Op : uint8_t
         {
-        case ScalarType::Bool:
-            return data_.b;
-        case ScalarType::Int64:
-            return data_.i != 0;
-        case ScalarType::UInt64:
-            return data_.u != 0;
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            return data_.d != 0.0;
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            return data_.z.real() != 0.0 || data_.z.imag() != 0.0;
-        default:
-            throw ScalarTypeError("Unsupported type conversion to bool");
-        }
-    }
+            Add,
+            Sub,
+            Mul,
+            Div
+        };
 
-    template <>
-    std::complex<double> Scalar::to<std::complex<double>>() const
-    {
-        switch (type_)
-        {
-        case ScalarType::Complex128:
-            return data_.z;
-        case ScalarType::Complex64:
-            return static_cast<std::complex<double>>(data_.z);
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            return std::complex<double>(data_.d, 0.0);
-        case ScalarType::Int64:
-            return std::complex<double>(static_cast<double>(data_.i), 0.0);
-        case ScalarType::UInt64:
-            return std::complex<double>(static_cast<double>(data_.u), 0.0);
-        case ScalarType::Bool:
-            return std::complex<double>(data_.b ? 1.0 : 0.0, 0.0);
-        default:
-            throw ScalarTypeError("Unsupported type conversion to complex<double>");
-        }
-    }
+        static constexpr size_t kNumOps = 4;
+        static constexpr size_t kNumTypes = static_cast<size_t>(ScalarType::Invalid) + 1;
 
-    // Arithmetic operations
-    Scalar Scalar::operator-() const
-    {
-        switch (type_)
-        {
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            return Scalar(-data_.d);
-        case ScalarType::Int64:
-            return Scalar(-data_.i);
-        case ScalarType::UInt64:
-            if (data_.u > 0)
-            {
-                throw ScalarTypeError("Cannot negate unsigned value");
-            }
-            return Scalar(0ull);
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            return Scalar(-data_.z);
-        case ScalarType::Bool:
-            throw ScalarTypeError("Cannot negate boolean value");
-        default:
-            throw ScalarTypeError("Unsupported type for negation");
-        }
-    }
+        using Kernel = Scalar (*)(const Scalar &, const Scalar &);
 
-    Scalar Scalar::operator+(const Scalar &other) const
-    {
-        // Handle same-type operations efficiently
-        if (type_ == other.type_)
+        template <ScalarType S>
+        using TypeTag = std::integral_constant<ScalarType, S>;
+
+        // Calls f(TypeTag<type>{}), turning a runtime type into a compile-time one
+        template <typename F>
+        static decltype(auto) withType(ScalarType type, F &&f)
         {
-            switch (type_)
+            switch (type)
             {
-            case ScalarType::Float64:
-                return Scalar(data_.d + other.data_.d);
+            case ScalarType::Int8:
+                return f(TypeTag<ScalarType::Int8>{});
+            case ScalarType::Int16:
+                return f(TypeTag<ScalarType::Int16>{});
+            case ScalarType::Int32:
+                return f(TypeTag<ScalarType::Int32>{});
             case ScalarType::Int64:
-                if (would_overflow(data_.i, other.data_.i, true))
-                {
-                    throw ScalarTypeError("Integer overflow in addition");
-                }
-                return Scalar(data_.i + other.data_.i);
+                return f(TypeTag<ScalarType::Int64>{});
+            case ScalarType::UInt8:
+                return f(TypeTag<ScalarType::UInt8>{});
+            case ScalarType::UInt16:
+                return f(TypeTag<ScalarType::UInt16>{});
+            case ScalarType::UInt32:
+                return f(TypeTag<ScalarType::UInt32>{});
             case ScalarType::UInt64:
-                if (data_.u > std::numeric_limits<uint64_t>::max() - other.data_.u)
-                {
-                    throw ScalarTypeError("Unsigned integer overflow in addition");
-                }
-                return Scalar(data_.u + other.data_.u);
+                return f(TypeTag<ScalarType::UInt64>{});
+            case ScalarType::Float32:
+                return f(TypeTag<ScalarType::Float32>{});
+            case ScalarType::Float64:
+                return f(TypeTag<ScalarType::Float64>{});
+            case ScalarType::Complex64:
+                return f(TypeTag<ScalarType::Complex64>{});
             case ScalarType::Complex128:
-                return Scalar(data_.z + other.data_.z);
+                return f(TypeTag<ScalarType::Complex128>{});
             case ScalarType::Bool:
-                throw ScalarTypeError("Cannot add boolean values");
+                return f(TypeTag<ScalarType::Bool>{});
             default:
-                break;
+                throw ScalarTypeError("Invalid scalar type");
             }
         }
 
-        // Handle mixed-type operations through promotion
-        if (isComplex() || other.isComplex())
-        {
-            std::complex<double> lhs = isComplex() ? data_.z : std::complex<double>(to<double>(), 0.0);
-            std::complex<double> rhs = other.isComplex() ? other.data_.z : std::complex<double>(other.to<double>(), 0.0);
-            return Scalar(lhs + rhs);
-        }
-        else if (isFloatingPoint() || other.isFloatingPoint())
+        // Calls f with the value of `s` in its own C++ type
+        template <typename F>
+        static decltype(auto) visit(const Scalar &s, F &&f)
         {
-            return Scalar(to<double>() + other.to<double>());
+            return withType(s.type_, [&](auto tag) -> decltype(auto)
+                            { return f(s.data_.get<scalar_t<decltype(tag)::value>>()); });
         }
-        else
-        {
-            // Integer promotion with overflow check
-            if (would_overflow(to<int64_t>(), other.to<int64_t>(), true))
-            {
-                throw ScalarTypeError("Integer overflow in addition");
-            }
-            return Scalar(to<int64_t>() + other.to<int64_t>());
-        }
-    }
 
-    Scalar Scalar::operator-(const Scalar &other) const
-    {
-        // Handle same-type operations efficiently
-        if (type_ == other.type_)
+        template <Op O, ScalarType B, typename T>
+        static Scalar compute(T a, T b)
         {
-            switch (type_)
+            if constexpr (O == Op::Div)
             {
-            case ScalarType::Float64:
-                return Scalar(data_.d - other.data_.d);
-
-            case ScalarType::Int64:
-                if (would_overflow(data_.i, other.data_.i, false))
-                { // false for subtraction
-                    throw ScalarTypeError("Integer overflow in subtraction");
+                if constexpr (is_complex_v<T>)
+                {
+                    if (b == T(0))
+                    {
+                        throw ScalarTypeError(isComplexType(B) ? "Division by complex zero" : "Division by zero");
+                    }
                 }
-                return Scalar(data_.i - other.data_.i);
-
-            case ScalarType::UInt64:
-                if (data_.u < other.data_.u)
-                { // Underflow check for unsigned
-                    throw ScalarTypeError("Unsigned integer underflow in subtraction");
+                else if (std::abs(static_cast<double>(b)) < std::numeric_limits<double>::epsilon())
+                {
+                    throw ScalarTypeError("Division by zero");
                 }
-                return Scalar(data_.u - other.data_.u);
-
-            case ScalarType::Complex128:
-                return Scalar(data_.z - other.data_.z);
-
-            case ScalarType::Bool:
-                throw ScalarTypeError("Cannot subtract boolean values");
-
-            default:
-                break;
             }
-        }
 
-        // Handle mixed-type operations through promotion
-        if (isComplex() || other.isComplex())
-        {
-            std::complex<double> lhs = isComplex() ? data_.z : std::complex<double>(to<double>(), 0.0);
-            std::complex<double> rhs = other.isComplex() ? other.data_.z : std::complex<double>(other.to<double>(), 0.0);
-            return Scalar(lhs - rhs);
-        }
-        else if (isFloatingPoint() || other.isFloatingPoint())
-        {
-            return Scalar(to<double>() - other.to<double>());
-        }
-        else
-        {
-            // Integer promotion with overflow check
-            if (would_overflow(to<int64_t>(), other.to<int64_t>(), false))
+            if constexpr (is_complex_v<T> || std::is_floating_point_v<T>)
             {
-                throw ScalarTypeError("Integer overflow in subtraction");
+                if constexpr (O == Op::Add)
+                    return Scalar(a + b);
+                else if constexpr (O == Op::Sub)
+                    return Scalar(a - b);
+                else if constexpr (O == Op::Mul)
+                    return Scalar(a * b);
+                else
+                    return Scalar(a / b);
             }
-            return Scalar(to<int64_t>() - other.to<int64_t>());
-        }
-    }
-
-    namespace
-    {
-        // Helper for multiplication overflow check
-        bool would_multiply_overflow(int64_t a, int64_t b)
-        {
-            if (a > 0)
+            else if constexpr (O == Op::Div)
             {
-                if (b > 0)
-                {
-                    if (a > std::numeric_limits<int64_t>::max() / b)
-                        return true;
-                }
-                else
-                {
-                    if (b < std::numeric_limits<int64_t>::min() / a)
-                        return true;
-                }
+                // Exact quotients stay integers, the rest promote to floating point
+                bool overflows = false;
+                if constexpr (std::is_signed_v<T>)
+                    overflows = a == std::numeric_limits<T>::min() && b == T(-1);
+                if (!overflows && a % b == 0)
+                    return Scalar(static_cast<T>(a / b));
+                return Scalar(static_cast<double>(a) / static_cast<double>(b));
             }
             else
             {
-                if (b > 0)
-                {
-                    if (a < std::numeric_limits<int64_t>::min() / b)
-                        return true;
-                }
+                T result;
+                bool overflow;
+                if constexpr (O == Op::Add)
+                    overflow = __builtin_add_overflow(a, b, &result);
+                else if constexpr (O == Op::Sub)
+                    overflow = __builtin_sub_overflow(a, b, &result);
                 else
+                    overflow = __builtin_mul_overflow(a, b, &result);
+                if (overflow)
                 {
-                    if (a != 0 && b < std::numeric_limits<int64_t>::max() / a)
-                        return true;
+                    constexpr const char *op = O == Op::Add ? "addition" : O == Op::Sub ? "subtraction"
+                                                                                       : "multiplication";
+                    throw ScalarTypeError(std::string(std::is_signed_v<T> ? "Integer" : "Unsigned integer") +
+                                          " overflow in " + op);
                 }
+                return Scalar(result);
             }
-            return false;
         }
 
-        bool would_multiply_overflow_unsigned(uint64_t a, uint64_t b)
+        template <ScalarType A, ScalarType B, Op O>
+        static Scalar kernel(const Scalar &lhs, const Scalar &rhs)
         {
-            if (b != 0 && a > std::numeric_limits<uint64_t>::max() / b)
-                return true;
-            return false;
-        }
-    }
-
-    Scalar Scalar::operator*(const Scalar &other) const
-    {
-        // Handle same-type operations efficiently
-        if (type_ == other.type_)
-        {
-            switch (type_)
+            constexpr ScalarType R = promote(A, B);
+            if constexpr (R == ScalarType::Invalid)
             {
-            case ScalarType::Float64:
-                return Scalar(data_.d * other.data_.d);
-
-            case ScalarType::Int64:
-                if (would_multiply_overflow(data_.i, other.data_.i))
+                throw ScalarTypeError("Unsupported type for arithmetic");
+            }
+            else
+            {
+                using T = scalar_t<R>;
+                T a = convert<T>(lhs.data_.get<scalar_t<A>>());
+                T b = convert<T>(rhs.data_.get<scalar_t<B>>());
+                if constexpr (R == ScalarType::Bool)
                 {
-                    throw ScalarTypeError("Integer overflow in multiplication");
+                    if constexpr (O == Op::Add)
+                        throw ScalarTypeError("Cannot add boolean values");
+                    else if constexpr (O == Op::Sub)
+                        throw ScalarTypeError("Cannot subtract boolean values");
+                    else if constexpr (O == Op::Mul)
+                        return Scalar(static_cast<bool>(a && b));
+                    else
+                        return compute<O, B>(static_cast<double>(a), static_cast<double>(b));
                 }
-                return Scalar(data_.i * other.data_.i);
-
-            case ScalarType::UInt64:
-                if (would_multiply_overflow_unsigned(data_.u, other.data_.u))
+                else
                 {
-                    throw ScalarTypeError("Unsigned integer overflow in multiplication");
+                    return compute<O, B>(a, b);
                 }
-                return Scalar(data_.u * other.data_.u);
-
-            case ScalarType::Complex128:
-                return Scalar(data_.z * other.data_.z);
-
-            case ScalarType::Bool:
-                return Scalar(static_cast<bool>(data_.b & other.data_.b));
-
-            default:
-                throw ScalarTypeError("Unsupported type for multiplication");
             }
         }
 
-        // Handle mixed-type operations
-        if (isComplex() || other.isComplex())
+        template <size_t... I>
+        static constexpr std::array<Kernel, sizeof...(I)> makeTable(std::index_sequence<I...>)
         {
-            std::complex<double> lhs = isComplex() ? data_.z : std::complex<double>(to<double>(), 0.0);
-            std::complex<double> rhs = other.isComplex() ? other.data_.z : std::complex<double>(other.to<double>(), 0.0);
-            return Scalar(lhs * rhs);
+            return {&kernel<static_cast<ScalarType>(I / (kNumTypes * kNumOps)),
+                            static_cast<ScalarType>(I / kNumOps % kNumTypes),
+                            static_cast<Op>(I % kNumOps)>...};
         }
 
-        // Then floating point
-        if (isFloatingPoint() || other.isFloatingPoint())
-        {
-            return Scalar(to<double>() * other.to<double>());
-        }
+        static Scalar apply(const Scalar &lhs, const Scalar &rhs, Op op);
+    };
 
-        // Integer multiplication with overflow check
-        if (would_multiply_overflow(to<int64_t>(), other.to<int64_t>()))
-        {
-            throw ScalarTypeError("Integer overflow in multiplication");
-        }
-        return Scalar(to<int64_t>() * other.to<int64_t>());
+    namespace
+    {
+        constexpr auto kBinaryKernels = ScalarDispatch::makeTable(
+            std::make_index_sequence<ScalarDispatch::kNumTypes * ScalarDispatch::kNumTypes * ScalarDispatch::kNumOps>());
     }
 
-    Scalar Scalar::operator/(const Scalar &other) const
+    Scalar ScalarDispatch::apply(const Scalar &lhs, const Scalar &rhs, Op op)
     {
-        // Handle division by zero with type-specific checks
-        if (other.type_ == ScalarType::Complex128)
-        {
-            if (other.data_.z == std::complex<double>(0.0, 0.0))
-            {
-                throw ScalarTypeError("Division by complex zero");
-            }
-        }
-        else
-        {
-            double val = other.to<double>();
-            if (std::abs(val) < std::numeric_limits<double>::epsilon())
-            {
-                throw ScalarTypeError("Division by zero");
-            }
-        }
-
-        // Handle division based on types
-        if (isComplex() || other.isComplex())
-        {
-            std::complex<double> lhs = isComplex() ? data_.z : std::complex<double>(to<double>(), 0.0);
-            std::complex<double> rhs = other.isComplex() ? other.data_.z : std::complex<double>(other.to<double>(), 0.0);
-            return Scalar(lhs / rhs);
-        }
-
-        // Integer division
-        if (isIntegral() && other.isIntegral())
-        {
-            // Check if division would be exact
-            double quotient = static_cast<double>(to<int64_t>()) / other.to<double>();
-            if (std::floor(quotient) != quotient)
-            {
-                // If not exact, promote to floating point
-                return Scalar(quotient);
-            }
-            // If exact and within bounds, keep as integer
-            if (quotient <= std::numeric_limits<int64_t>::max() &&
-                quotient >= std::numeric_limits<int64_t>::min())
-            {
-                return Scalar(static_cast<int64_t>(quotient));
-            }
-        }
-
-        // Default to floating point division for other cases
-        return Scalar(to<double>() / other.to<double>());
+        size_t index = (static_cast<size_t>(lhs.type_) * kNumTypes + static_cast<size_t>(rhs.type_)) * kNumOps +
+                       static_cast<size_t>(op);
+        return kBinaryKernels[index](lhs, rhs);
     }
 
-    bool Scalar::operator==(const Scalar &other) const
+    // Type conversion implementations
+    template <typename T>
+    T Scalar::to() const
     {
-        // Same type comparisons (most common case)
-        if (type_ == other.type_)
-        {
-            switch (type_)
-            {
-            case ScalarType::Float64:
-                return almost_equal(data_.d, other.data_.d);
-
-            case ScalarType::Int64:
-                return data_.i == other.data_.i;
-
-            case ScalarType::UInt64:
-                return data_.u == other.data_.u;
-
-            case ScalarType::Complex128:
-                return complex_almost_equal(data_.z, other.data_.z);
-
-            case ScalarType::Bool:
-                return data_.b == other.data_.b;
+        return ScalarDispatch::visit(*this, [](auto value)
+                                     { return convert<T>(value); });
+    }
 
-            default:
-                return false;
-            }
-        }
+    template int8_t Scalar::to<int8_t>() const;
+    template int16_t Scalar::to<int16_t>() const;
+    template int32_t Scalar::to<int32_t>() const;
+    template int64_t Scalar::to<int64_t>() const;
+    template uint8_t Scalar::to<uint8_t>() const;
+    template uint16_t Scalar::to<uint16_t>() const;
+    template uint32_t Scalar::to<uint32_t>() const;
+    template uint64_t Scalar::to<uint64_t>() const;
+    template float Scalar::to<float>() const;
+    template double Scalar::to<double>() const;
+    template std::complex<float> Scalar::to<std::complex<float>>() const;
+    template std::complex<double> Scalar::to<std::complex<double>>() const;
+    template bool Scalar::to<bool>() const;
+
+    Scalar Scalar::to(ScalarType type) const
+    {
+        return ScalarDispatch::withType(type, [this](auto tag)
+                                        {
+            Scalar result(to<scalar_t<decltype(tag)::value>>());
+            result.device_ = device_;
+            return result; });
+    }
 
-        // Mixed-type comparisons
-        try
-        {
-            // If either is boolean, require exact boolean comparison
-            if (isBoolean() || other.isBoolean())
+    // Arithmetic operations
+    Scalar Scalar::operator-() const
+    {
+        return ScalarDispatch::visit(*this, [](auto value) -> Scalar
+                                     {
+            using T = decltype(value);
+            if constexpr (std::is_same_v<T, bool>)
             {
-                // Only allow bool == bool, not bool == number
-                return false;
+                throw ScalarTypeError("Cannot negate boolean value");
             }
-
-            // If either is complex
-            if (isComplex() || other.isComplex())
+            else if constexpr (std::is_unsigned_v<T>)
             {
-                // Only compare complex numbers if both can be converted to complex
-                if (!isComplex())
-                {
-                    // Convert non-complex to complex for comparison
-                    return complex_almost_equal(
-                        std::complex<double>(to<double>(), 0.0),
-                        other.data_.z);
-                }
-                else if (!other.isComplex())
+                if (value > 0)
                 {
-                    return complex_almost_equal(
-                        data_.z,
-                        std::complex<double>(other.to<double>(), 0.0));
+                    throw ScalarTypeError("Cannot negate unsigned value");
                 }
-                return false;
+                return Scalar(value);
             }
-
-            // If either is floating point
-            if (isFloatingPoint() || other.isFloatingPoint())
+            else if constexpr (std::is_integral_v<T>)
             {
-                return almost_equal(to<double>(), other.to<double>());
-            }
-
-            // If both are integer types (signed or unsigned)
-            if (isIntegral() && other.isIntegral())
-            {
-                // Handle potential overflow in conversion
-                try
+                if (value == std::numeric_limits<T>::min())
                 {
-                    return to<int64_t>() == other.to<int64_t>();
-                }
-                catch (const ScalarTypeError &)
-                {
-                    // If conversion fails, try unsigned comparison
-                    return to<uint64_t>() == other.to<uint64_t>();
+                    throw ScalarTypeError("Integer overflow in negation");
                 }
+                return Scalar(static_cast<T>(-value));
             }
-
-            return false;
-        }
-        catch (const ScalarTypeError &)
-        {
-            return false; // If conversion fails, values are not equal
-        }
+            else
+            {
+                return Scalar(-value);
+            } });
     }
 
-    ScalarType Scalar::promoteTypes(ScalarType a, ScalarType b)
+    Scalar Scalar::operator+(const Scalar &other) const
     {
-        // Same type, no promotion needed
-        if (a == b)
-            return a;
-
-        // Handle invalid types
-        if (a == ScalarType::Invalid || b == ScalarType::Invalid)
-        {
-            return ScalarType::Invalid;
-        }
-
-        // Special handling for boolean
-        if (a == ScalarType::Bool)
-            return b;
-        if (b == ScalarType::Bool)
-            return a;
-
-        // Complex type promotion
-        if (isComplexType(a) || isComplexType(b))
-        {
-            // Always promote to Complex128 for maximum precision
-            return ScalarType::Complex128;
-        }
-
-        // Floating point promotion
-        if (isFloatingType(a) || isFloatingType(b))
-        {
-            // If either is Float64, promote to Float64
-            if (a == ScalarType::Float64 || b == ScalarType::Float64)
-            {
-                return ScalarType::Float64;
-            }
-            return ScalarType::Float32;
-        }
-
-        // Integer promotion rules
-        if (isIntegralType(a) && isIntegralType(b))
-        {
-            bool aUnsigned = isUnsignedType(a);
-            bool bUnsigned = isUnsignedType(b);
-            int aWidth = getTypeWidth(a);
-            int bWidth = getTypeWidth(b);
+        return ScalarDispatch::apply(*this, other, ScalarDispatch::Op::Add);
+    }
 
-            // If both unsigned or both signed, use the wider type
-            if (aUnsigned == bUnsigned)
-            {
-                return (aWidth >= bWidth) ? a : b;
-            }
+    Scalar Scalar::operator-(const Scalar &other) const
+    {
+        return ScalarDispatch::apply(*this, other, ScalarDispatch::Op::Sub);
+    }
 
-            // One signed, one unsigned
-            ScalarType unsignedType = aUnsigned ? a : b;
-            ScalarType signedType = aUnsigned ? b : a;
+    Scalar Scalar::operator*(const Scalar &other) const
+    {
+        return ScalarDispatch::apply(*this, other, ScalarDispatch::Op::Mul);
+    }
 
-            // If unsigned type is wider or equal, use it
-            if (getTypeWidth(unsignedType) >= getTypeWidth(signedType))
-            {
-                return unsignedType;
-            }
+    Scalar Scalar::operator/(const Scalar &other) const
+    {
+        return ScalarDispatch::apply(*this, other, ScalarDispatch::Op::Div);
+    }
 
-            // Otherwise use the signed type of the next size up
-            switch (getTypeWidth(signedType))
-            {
-            case 8:
-                return ScalarType::Int16;
-            case 16:
-                return ScalarType::Int32;
-            case 32:
-                return ScalarType::Int64;
-            default:
-                return ScalarType::Int64; // Can't go higher than 64 bits
-            }
-        }
+    bool Scalar::operator==(const Scalar &other) const
+    {
+        return ScalarDispatch::visit(*this, [&](auto lhs)
+                                     { return ScalarDispatch::visit(other, [&](auto rhs)
+                                                                    { return equal(lhs, rhs); }); });
+    }
 
-        // Default to Float64 for any other combination
-        return ScalarType::Float64;
+    ScalarType Scalar::promoteTypes(ScalarType a, ScalarType b)
+    {
+        return promote(a, b);
     }
 
     // Type conversion and string utilities
@@ -834,10 +593,18 @@ namespace enigma
             return "Int64";
         case ScalarType::Int32:
             return "Int32";
+        case ScalarType::Int16:
+            return "Int16";
+        case ScalarType::Int8:
+            return "Int8";
         case ScalarType::UInt64:
             return "UInt64";
         case ScalarType::UInt32:
             return "UInt32";
+        case ScalarType::UInt16:
+            return "UInt16";
+        case ScalarType::UInt8:
+            return "UInt8";
         case ScalarType::Complex128:
             return "Complex128";
         case ScalarType::Complex64:
@@ -851,30 +618,29 @@ namespace enigma
 
     std::string Scalar::toString() const
     {
+        if (type_ == ScalarType::Invalid)
+            return "Unknown";
         std::ostringstream ss;
-        ss << std::setprecision(17);
-        switch (type_)
-        {
-        case ScalarType::Float64:
-        case ScalarType::Float32:
-            ss << data_.d;
-            break;
-        case ScalarType::Int64:
-            ss << data_.i;
-            break;
-        case ScalarType::UInt64:
-            ss << data_.u;
-            break;
-        case ScalarType::Complex128:
-        case ScalarType::Complex64:
-            ss << data_.z.real() << "+" << data_.z.imag() << "j";
-            break;
-        case ScalarType::Bool:
-            ss << (data_.b ? "true" : "false");
-            break;
-        default:
-            ss << "Unknown";
-        }
+        ScalarDispatch::visit(*this, [&ss](auto value)
+                              {
+            using T = decltype(value);
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                ss << (value ? "true" : "false");
+            }
+            else if constexpr (is_complex_v<T>)
+            {
+                ss << std::setprecision(std::numeric_limits<typename T::value_type>::max_digits10)
+                   << value.real() << "+" << value.imag() << "j";
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                ss << std::setprecision(std::numeric_limits<T>::max_digits10) << value;
+            }
+            else
+            {
+                ss << +value; // int8_t and uint8_t as numbers, not characters
+            } });
         return ss.str();
     }
 
@@ -886,4 +652,4 @@ namespace enigma
         return result;
     }
 
-} // namespace enigma
\ No newline at end of file
+} // namespace enigma
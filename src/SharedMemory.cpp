@@ -0,0 +1,196 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MemoryStats.h"
+#include "SharedMemory.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    constexpr uint64_t kMagic = 0x454e49474d415348; // "ENIGMASH"
+
+    // First page of every object, shared by all processes mapping it
+    struct SharedHeader
+    {
+      uint64_t magic;
+      std::atomic<int64_t> refcount; // live mappings across all processes
+      size_t size;                   // usable bytes after the header page
+      char name[64];                 // shm_open name to unlink, empty for memfd
+    };
+
+    static_assert(std::atomic<int64_t>::is_always_lock_free,
+                  "the refcount must be lock-free to work across processes");
+
+    SharedHeader *header_of(void *base)
+    {
+      return static_cast<SharedHeader *>(base);
+    }
+
+    // Returns a descriptor for a new, empty object; `name` is left empty for memfd
+    int create_object(char (&name)[64])
+    {
+      name[0] = '\0';
+#ifdef MFD_CLOEXEC
+      int fd = memfd_create("enigma", MFD_CLOEXEC);
+      if (fd >= 0 || errno != ENOSYS)
+        return fd;
+#endif
+      static std::atomic<uint64_t> counter{0};
+      std::snprintf(name, sizeof(name), "/enigma_%d_%llu", static_cast<int>(getpid()),
+                    static_cast<unsigned long long>(counter.fetch_add(1)));
+      return shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    }
+  } // namespace
+
+  SharedMemoryAllocator::~SharedMemoryAllocator()
+  {
+    for (auto &[ptr, mapping] : mappings_)
+      release(mapping);
+  }
+
+  void *SharedMemoryAllocator::allocate(size_t num_bytes, size_t alignment)
+  {
+    if (!is_valid_alignment(alignment) || alignment > page_size())
+    {
+      throw std::invalid_argument("Shared memory alignment must be a power of two no larger than a page");
+    }
+
+    char name[64];
+    int fd = create_object(name);
+    if (fd < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "Cannot create shared memory object");
+    }
+    size_t length = page_size() + num_bytes;
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0)
+    {
+      int error = errno;
+      close(fd);
+      if (name[0] != '\0')
+        shm_unlink(name);
+      throw std::system_error(error, std::generic_category(), "Cannot size shared memory object");
+    }
+
+    void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      int error = errno;
+      close(fd);
+      if (name[0] != '\0')
+        shm_unlink(name);
+      throw std::system_error(error, std::generic_category(), "Cannot map shared memory object");
+    }
+
+    // Fresh object pages are zero, so placement-new the header over them
+    auto *header = new (base) SharedHeader{kMagic, {1}, num_bytes, {}};
+    std::memcpy(header->name, name, sizeof(name));
+
+    void *data = static_cast<char *>(base) + page_size();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      mappings_.emplace(data, Mapping{fd, base, length});
+    }
+    stats::record_allocation(device(), length);
+    stats::record_reserved(device(), static_cast<int64_t>(length));
+    return data;
+  }
+
+  void *SharedMemoryAllocator::import(int fd, size_t num_bytes)
+  {
+    int own_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (own_fd < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "Invalid shared memory handle");
+    }
+
+    struct stat info;
+    size_t length = page_size() + num_bytes;
+    if (fstat(own_fd, &info) != 0 || static_cast<size_t>(info.st_size) < length)
+    {
+      close(own_fd);
+      throw std::out_of_range("Shared memory object is smaller than the requested size");
+    }
+
+    void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, own_fd, 0);
+    if (base == MAP_FAILED)
+    {
+      int error = errno;
+      close(own_fd);
+      throw std::system_error(error, std::generic_category(), "Cannot map shared memory object");
+    }
+
+    SharedHeader *header = header_of(base);
+    if (header->magic != kMagic || header->size < num_bytes)
+    {
+      munmap(base, length);
+      close(own_fd);
+      throw std::invalid_argument("Not a shared memory object created by SharedMemoryAllocator");
+    }
+    header->refcount.fetch_add(1, std::memory_order_relaxed);
+
+    void *data = static_cast<char *>(base) + page_size();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      mappings_.emplace(data, Mapping{own_fd, base, length});
+    }
+    stats::record_allocation(device(), length);
+    stats::record_reserved(device(), static_cast<int64_t>(length));
+    return data;
+  }
+
+  void SharedMemoryAllocator::deallocate(void *ptr)
+  {
+    if (ptr == nullptr)
+      return;
+
+    Mapping mapping;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = mappings_.find(ptr);
+      if (it == mappings_.end())
+      {
+        throw std::invalid_argument("Pointer was not allocated by this SharedMemoryAllocator");
+      }
+      mapping = it->second;
+      mappings_.erase(it);
+    }
+    release(mapping);
+    stats::record_free(device(), mapping.length);
+    stats::record_reserved(device(), -static_cast<int64_t>(mapping.length));
+  }
+
+  int SharedMemoryAllocator::fd_of(const void *ptr) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = mappings_.find(ptr);
+    return it == mappings_.end() ? -1 : it->second.fd;
+  }
+
+  void SharedMemoryAllocator::release(const Mapping &mapping)
+  {
+    SharedHeader *header = header_of(mapping.base);
+    if (header->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1 && header->name[0] != '\0')
+      shm_unlink(header->name);
+    munmap(mapping.base, mapping.length);
+    close(mapping.fd);
+  }
+
+  std::shared_ptr<SharedMemoryAllocator> get_shared_memory_allocator()
+  {
+    // Leaked like the device allocators, for Storages destroyed during exit
+    static auto *allocator = new std::shared_ptr<SharedMemoryAllocator>(std::make_shared<SharedMemoryAllocator>());
+    return *allocator;
+  }
+
+} // namespace enigma
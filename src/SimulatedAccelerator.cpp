@@ -0,0 +1,112 @@
+#include <stdexcept>
+#include "CopyEngine.h"
+#include "SimulatedAccelerator.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  SimulatedAccelerator::SimulatedAccelerator()
+      : allocator_(std::make_shared<CachingAllocator>(Device(DeviceType::SIM)))
+  {
+  }
+
+  SimulatedAccelerator::~SimulatedAccelerator()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    queued_.notify_all();
+    if (copy_thread_.joinable())
+      copy_thread_.join();
+  }
+
+  std::shared_ptr<Allocator> SimulatedAccelerator::allocator(const Device &)
+  {
+    return allocator_;
+  }
+
+  void SimulatedAccelerator::copy(void *dst, const Device &dst_device, const void *src, const Device &src_device,
+                                  size_t num_bytes)
+  {
+    // Through the queue, so it is ordered after copies already in flight
+    wait(copy_async(dst, dst_device, src, src_device, num_bytes));
+  }
+
+  CopyTicket SimulatedAccelerator::copy_async(void *dst, const Device &, const void *src, const Device &,
+                                              size_t num_bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!copy_thread_.joinable())
+      copy_thread_ = std::thread([this]
+                                 { run(); });
+    CopyTicket ticket = ++last_ticket_;
+    queue_.push_back({dst, src, num_bytes, ticket});
+    queued_.notify_one();
+    return ticket;
+  }
+
+  bool SimulatedAccelerator::is_complete(CopyTicket ticket) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ticket <= completed_ticket_;
+  }
+
+  void SimulatedAccelerator::wait(CopyTicket ticket)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    completed_.wait(lock, [&]
+                    { return ticket <= completed_ticket_; });
+  }
+
+  void SimulatedAccelerator::synchronize()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    CopyTicket last = last_ticket_;
+    completed_.wait(lock, [&]
+                    { return last <= completed_ticket_; });
+  }
+
+  void SimulatedAccelerator::set_link(double bytes_per_second, std::chrono::nanoseconds latency)
+  {
+    if (bytes_per_second < 0 || latency.count() < 0)
+    {
+      throw std::invalid_argument("Link bandwidth and latency cannot be negative");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_per_second_ = bytes_per_second;
+    latency_ = latency;
+  }
+
+  void SimulatedAccelerator::run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+      queued_.wait(lock, [this]
+                   { return stopping_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      Transfer transfer = queue_.front();
+      queue_.pop_front();
+      auto duration = latency_;
+      if (bytes_per_second_ > 0)
+        duration += std::chrono::nanoseconds(static_cast<int64_t>(transfer.num_bytes / bytes_per_second_ * 1e9));
+      lock.unlock();
+
+      auto start = std::chrono::steady_clock::now();
+      copy_bytes(transfer.dst, transfer.src, transfer.num_bytes);
+      std::this_thread::sleep_until(start + duration);
+
+      lock.lock();
+      completed_ticket_ = transfer.ticket;
+      completed_.notify_all();
+    }
+  }
+
+  SimulatedAccelerator &simulated_accelerator()
+  {
+    return static_cast<SimulatedAccelerator &>(get_backend(DeviceType::SIM));
+  }
+
+} // namespace enigma
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include "Snapshot.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  namespace
+  {
+    constexpr char kMagic[8] = {'E', 'N', 'I', 'G', 'S', 'N', 'A', 'P'};
+
+    void write_u64(std::ostream &out, uint64_t value)
+    {
+      out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    uint64_t read_u64(std::istream &in)
+    {
+      uint64_t value = 0;
+      if (!in.read(reinterpret_cast<char *>(&value), sizeof(value)))
+      {
+        throw std::runtime_error("Truncated snapshot");
+      }
+      return value;
+    }
+  } // namespace
+
+  size_t Snapshot::num_changed() const
+  {
+    return std::count_if(entries_.begin(), entries_.end(), [](const Entry &entry)
+                         { return entry.changed; });
+  }
+
+  void Snapshot::write(std::ostream &out, bool changed_only) const
+  {
+    out.write(kMagic, sizeof(kMagic));
+    write_u64(out, id_);
+    write_u64(out, entries_.size());
+    write_u64(out, changed_only ? num_changed() : entries_.size());
+    for (size_t i = 0; i < entries_.size(); i++)
+    {
+      const Entry &entry = entries_[i];
+      if (changed_only && !entry.changed)
+        continue;
+      write_u64(out, i);
+      write_u64(out, entry.version);
+      write_u64(out, entry.storage->size_bytes());
+      out.write(static_cast<const char *>(entry.storage->const_data()),
+                static_cast<std::streamsize>(entry.storage->size_bytes()));
+    }
+    if (!out)
+    {
+      throw std::runtime_error("Failed to write snapshot");
+    }
+  }
+
+  std::vector<StoragePtr> Snapshot::read(std::istream &in, size_t *num_entries)
+  {
+    char magic[sizeof(kMagic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+    {
+      throw std::runtime_error("Not a snapshot");
+    }
+    read_u64(in); // id
+    uint64_t total = read_u64(in);
+    uint64_t stored = read_u64(in);
+    if (stored > total)
+    {
+      throw std::runtime_error("Corrupt snapshot header");
+    }
+
+    std::vector<StoragePtr> storages(total);
+    for (uint64_t i = 0; i < stored; i++)
+    {
+      uint64_t index = read_u64(in);
+      read_u64(in); // version
+      uint64_t size = read_u64(in);
+      if (index >= total)
+      {
+        throw std::runtime_error("Corrupt snapshot entry");
+      }
+      auto storage = Storage::create(size, Device(DeviceType::CPU));
+      if (!in.read(static_cast<char *>(storage->mutable_data()), static_cast<std::streamsize>(size)))
+      {
+        throw std::runtime_error("Truncated snapshot");
+      }
+      storages[index] = std::move(storage);
+    }
+    if (num_entries)
+      *num_entries = stored;
+    return storages;
+  }
+
+  Snapshotter::Snapshotter(std::vector<StoragePtr> storages) : storages_(std::move(storages))
+  {
+    for (const auto &storage : storages_)
+    {
+      if (!storage)
+      {
+        throw std::invalid_argument("Snapshotter needs non-null storages");
+      }
+    }
+  }
+
+  std::shared_ptr<const Snapshot> Snapshotter::snapshot()
+  {
+    auto previous = previous_.lock();
+    bool first = next_id_ == 1;
+    std::vector<Snapshot::Entry> entries;
+    entries.reserve(storages_.size());
+    versions_.resize(storages_.size());
+
+    for (size_t i = 0; i < storages_.size(); i++)
+    {
+      Storage &storage = *storages_[i];
+      uint64_t version = storage.version();
+      bool changed = first || version != versions_[i];
+      if (!changed && previous)
+        entries.push_back({(*previous)[i].storage, version, false});
+      else
+        entries.push_back({Storage::lazy_clone(storage), version, changed});
+      versions_[i] = version;
+    }
+
+    auto snapshot = std::make_shared<const Snapshot>(next_id_++, std::move(entries));
+    previous_ = snapshot;
+    return snapshot;
+  }
+
+  std::future<void> write_snapshot_async(std::shared_ptr<const Snapshot> snapshot, std::string path, bool changed_only)
+  {
+    return std::async(std::launch::async, [snapshot = std::move(snapshot), path = std::move(path), changed_only]() mutable
+                      {
+                        {
+                          std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                          if (!out)
+                          {
+                            throw std::runtime_error("Cannot open " + path);
+                          }
+                          snapshot->write(out, changed_only);
+                        }
+                        snapshot.reset(); // release the frozen buffers as soon as they are on disk
+                      });
+  }
+
+} // namespace enigma
@@ -1,33 +1,86 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
 #include <stdexcept>
+#include "Backend.h"
 #include "COW.h"
+#include "CopyEngine.h"
+#include "MemoryStats.h"
+#include "Numa.h"
+#include "PagePolicy.h"
+#include "SharedMemory.h"
 #include "Storage.h"
+#include "Stream.h"
 #include "DEBUG.h"
 
 namespace enigma
 {
-  Storage::Storage(size_t size_bytes, const Device &device) : size_bytes_(size_bytes), device_(device)
+  // One reference for the Storage object and one for the DataPtr over the
+  // payload; the latter can outlive the Storage when COW clones share it.
+  struct Storage::CoallocatedBlock
   {
+    std::atomic<int> refcount{2};
+    Allocator *allocator; // not owned: must outlive the block, as in adopt_allocation()
+
+    explicit CoallocatedBlock(Allocator *allocator) : allocator(allocator) {}
+
+    void release()
+    {
+      if (refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        Allocator *owner = allocator;
+        this->~CoallocatedBlock();
+        owner->deallocate(this);
+      }
+    }
+
+    static void release_payload(DataPtr *data_ptr)
+    {
+      static_cast<CoallocatedBlock *>(data_ptr->get_context())->release();
+    }
+  };
+
+  namespace
+  {
+    constexpr size_t round_up(size_t n, size_t multiple)
+    {
+      return (n + multiple - 1) / multiple * multiple;
+    }
+  } // namespace
+
+  Storage::Storage(size_t size_bytes, const Device &device, size_t alignment)
+      : size_bytes_(size_bytes), capacity_bytes_(size_bytes), device_(device), alignment_(alignment), owns_allocation_(false)
+  {
+    if (!is_valid_alignment(alignment))
+    {
+      throw std::invalid_argument("Storage alignment must be a power of two");
+    }
 
     allocator_ = get_allocator(device);
     if (!allocator_)
     {
       throw std::runtime_error("Failed to get allocator for device");
     }
-    if (size_bytes > 0)
+    if (fits_inline(size_bytes))
+      data_ptr_ = DataPtr(inline_buffer_, nullptr, nullptr, device);
+    else if (size_bytes > 0)
       allocate(); // this is a bad design, instead have a method that returns unallocated data Storage
   }
 
-  Storage::Storage(size_t size_bytes, void *data, const Device &device) : size_bytes_(size_bytes), device_(device), allocator_(get_allocator(device))
+  Storage::Storage(size_t size_bytes, void *data, const Device &device)
+      : size_bytes_(size_bytes), capacity_bytes_(0), device_(device), alignment_(DataPtr::alignment_of(data)),
+        allocator_(get_allocator(device)), owns_allocation_(false)
   {
     if (data == nullptr)
     {
       throw std::invalid_argument("Data pointer cannot be null");
     }
 
-    data_ptr_ = std::make_unique<DataPtr>(data, nullptr, nullptr, device);
+    data_ptr_ = DataPtr(data, nullptr, nullptr, device);
   }
 
-  Storage::Storage() : size_bytes_(0)
+  Storage::Storage() : size_bytes_(0), capacity_bytes_(0), alignment_(kDefaultAlignment), owns_allocation_(false)
   {
   }
 
@@ -38,57 +91,462 @@ namespace enigma
 
   void Storage::allocate()
   {
+    if (is_meta())
+    {
+      // Accounted like an allocation, for memory planning
+      stats::record_allocation(device_, capacity_bytes_);
+      owns_allocation_ = true;
+      return;
+    }
 
-    void *ptr = allocator_->allocate(size_bytes_);
+    void *ptr = allocator_->allocate(capacity_bytes_, alignment_);
     if (ptr == nullptr)
       throw std::bad_alloc();
+    adopt_allocation(ptr);
+  }
 
-    data_ptr_ = std::make_unique<DataPtr>(ptr, nullptr, [this](DataPtr *p)
-                                          { allocator_->deallocate(p->get()); }, device_); // data, ctx, deleter, device
+  void Storage::adopt_allocation(void *ptr)
+  {
+    // The allocator rather than `this` is the context: COW can hand the DataPtr to
+    // another Storage. The allocator must outlive every DataPtr built from it;
+    // device allocators live for the whole process, arenas only guarantee it
+    // inside their ArenaScope (see Arena.h).
+    data_ptr_ = DataPtr(ptr, allocator_.get(), deallocate_data_ptr, device_); // data, ctx, deleter, device
+    owns_allocation_ = true;
   }
 
   void Storage::deallocate()
   {
-
-    data_ptr_.reset();
+    if (is_meta() && owns_allocation_)
+    {
+      stats::record_free(device_, capacity_bytes_);
+      owns_allocation_ = false;
+    }
+    drop_expired_streams();
+    // Never inline here: record_stream() moved the payload to the allocator
+    if (!stream_uses_.empty() && data_ptr_)
+    {
+      // A chunked clone's work may also read chunks still in the source
+      struct Retired
+      {
+        DataPtr data_ptr;
+        std::unique_ptr<cow::ChunkedCOW> chunks;
+      };
+      release_after_streams(stream_uses_, std::make_shared<Retired>(Retired{std::move(data_ptr_), std::move(chunks_)}));
+    }
+    data_ptr_.clear();
   }
 
-  void Storage::resize(size_t new_size_bytes)
+  void Storage::reallocate(size_t new_capacity_bytes)
   {
-    if (new_size_bytes == size_bytes_)
+    if (!allocator_)
+      allocator_ = get_allocator(device_);
+
+    if (is_meta())
+    {
+      deallocate();
+      capacity_bytes_ = new_capacity_bytes;
+      allocate();
+      return;
+    }
+
+    // In place only when no stream may still be using the old block
+    drop_expired_streams();
+    if (owns_buffer() && stream_uses_.empty())
+    {
+      void *ptr = allocator_->reallocate(data(), capacity_bytes_, new_capacity_bytes, alignment_);
+      data_ptr_.set_deleter(nullptr); // the old block was consumed by reallocate
+      capacity_bytes_ = new_capacity_bytes;
+      adopt_allocation(ptr);
       return;
+    }
 
+    // Someone else's buffer, or one a stream may still use: copy out of it and
+    // drop our reference
+    if (chunks_)
+      materialize_chunks();
+    void *ptr = allocator_->allocate(new_capacity_bytes, alignment_);
+    if (data())
+      copy_bytes(ptr, data(), std::min(size_bytes_, new_capacity_bytes));
     deallocate();
+    capacity_bytes_ = new_capacity_bytes;
+    adopt_allocation(ptr);
+  }
+
+  // lazy_clone turns our DataPtr into a shared COW one in place, so the flag
+  // alone is not enough
+  bool Storage::owns_buffer() const
+  {
+    return owns_allocation_ && data_ptr_ && !is_cow();
+  }
+
+  // An inline buffer dies with the Storage, so it cannot be handed to streams
+  bool Storage::fits_inline(size_t size_bytes) const
+  {
+    return size_bytes > 0 && size_bytes <= kInlineBytes && device_.is_cpu() && alignment_ <= kDefaultAlignment &&
+           stream_uses_.empty();
+  }
+
+  size_t Storage::capacity_bytes() const
+  {
+    if (is_inline())
+      return kInlineBytes;
+    if (is_meta())
+      return owns_allocation_ ? std::max(capacity_bytes_, size_bytes_) : size_bytes_;
+    return owns_buffer() ? std::max(capacity_bytes_, size_bytes_) : size_bytes_;
+  }
+
+  void Storage::resize(size_t new_size_bytes)
+  {
+    bump_version();
+    if (new_size_bytes > capacity_bytes())
+      reallocate(std::max(new_size_bytes, 2 * capacity_bytes()));
     size_bytes_ = new_size_bytes;
-    allocate();
   }
 
-  void Storage::set_data_ptr(std::unique_ptr<DataPtr> new_data_ptr)
+  void Storage::reserve(size_t capacity_bytes)
+  {
+    if (capacity_bytes > this->capacity_bytes())
+      reallocate(capacity_bytes);
+  }
+
+  void Storage::shrink_to_fit()
+  {
+    if (!owns_buffer() || capacity_bytes_ <= size_bytes_)
+      return;
+    if (size_bytes_ == 0)
+    {
+      deallocate();
+      capacity_bytes_ = 0;
+      owns_allocation_ = false;
+      return;
+    }
+    reallocate(size_bytes_);
+  }
+
+  int Storage::numa_node() const
+  {
+    return numa::node_of(data_ptr_.get(), size_bytes_);
+  }
+
+  void Storage::drop_expired_streams()
   {
+    std::erase_if(stream_uses_, [](const std::weak_ptr<StreamState> &use)
+                  { return use.expired(); });
+  }
+
+  void Storage::record_stream(const Stream &stream)
+  {
+    drop_expired_streams();
+    // Freeing must never wait on a stream, which could be the one freeing it
+    if (is_inline())
+      reallocate(kInlineBytes);
+    for (const auto &use : stream_uses_)
+    {
+      if (!use.owner_before(stream.state_) && !stream.state_.owner_before(use))
+        return;
+    }
+    stream_uses_.push_back(stream.state_);
+  }
+
+  size_t Storage::huge_page_bytes() const
+  {
+    return enigma::huge_page_bytes(data_ptr_.get(), size_bytes_);
+  }
+
+  void Storage::set_data_ptr(DataPtr new_data_ptr)
+  {
+    bump_version();
+    deallocate();
+    chunks_.reset();
     data_ptr_ = std::move(new_data_ptr);
+    owns_allocation_ = false;
+    capacity_bytes_ = 0;
   }
 
-  std::shared_ptr<Storage> Storage::create_uninitialized(size_t size_bytes, const Device &device)
+  void Storage::replace_with_allocation(void *ptr, size_t capacity_bytes)
   {
-    auto storage = std::make_shared<Storage>();
+    bump_version();
+    deallocate();
+    chunks_.reset();
+    capacity_bytes_ = capacity_bytes;
+    adopt_allocation(ptr);
+  }
+
+  StoragePtr Storage::create(size_t size_bytes, const Device &device, size_t alignment)
+  {
+    if (size_bytes > kMaxCoallocatedBytes || size_bytes <= kInlineBytes || !device.is_cpu())
+      return make_intrusive<Storage>(size_bytes, device, alignment);
+    if (!is_valid_alignment(alignment))
+    {
+      throw std::invalid_argument("Storage alignment must be a power of two");
+    }
+
+    // [block header | Storage | payload], the payload aligned like a normal allocation
+    auto allocator = get_allocator(device);
+    size_t storage_offset = round_up(sizeof(CoallocatedBlock), alignof(Storage));
+    size_t payload_offset = round_up(storage_offset + sizeof(Storage), alignment);
+    void *base = allocator->allocate(payload_offset + size_bytes, std::max(alignment, alignof(Storage)));
+    if (base == nullptr)
+      throw std::bad_alloc();
+
+    auto *block = new (base) CoallocatedBlock(allocator.get());
+    auto *storage = new (static_cast<char *>(base) + storage_offset) Storage();
     storage->size_bytes_ = size_bytes;
+    storage->capacity_bytes_ = size_bytes;
     storage->device_ = device;
+    storage->alignment_ = alignment;
+    storage->allocator_ = std::move(allocator);
+    storage->coallocated_block_ = block;
+    storage->data_ptr_ = DataPtr(static_cast<char *>(base) + payload_offset, block,
+                                 CoallocatedBlock::release_payload, device);
+    return StoragePtr(storage);
+  }
+
+  void Storage::destroy(Storage *storage)
+  {
+    CoallocatedBlock *block = storage->coallocated_block_;
+    if (block == nullptr)
+    {
+      delete storage;
+      return;
+    }
+    storage->~Storage();
+    block->release();
+  }
+
+  StoragePtr Storage::create_uninitialized(size_t size_bytes, const Device &device, size_t alignment)
+  {
+    if (!is_valid_alignment(alignment))
+    {
+      throw std::invalid_argument("Storage alignment must be a power of two");
+    }
+    auto storage = make_intrusive<Storage>();
+    storage->size_bytes_ = size_bytes;
+    storage->capacity_bytes_ = size_bytes;
+    storage->device_ = device;
+    storage->alignment_ = alignment;
     storage->allocator_ = get_allocator(device);
     return storage;
   }
-  std::shared_ptr<Storage> Storage::lazy_clone(Storage &src)
+  StoragePtr Storage::lazy_clone(Storage &src)
   {
     return cow::lazy_clone_storage(src);
   }
 
+  StoragePtr Storage::create_kernel_cow(size_t size_bytes)
+  {
+    Device cpu(DeviceType::CPU);
+    if (size_bytes < kMinKernelCOWBytes)
+      return create(size_bytes, cpu);
+    auto storage = create_uninitialized(size_bytes, cpu, page_size());
+    storage->set_data_ptr(cow::make_kernel_cow_data_ptr(size_bytes, cpu));
+    return storage;
+  }
+
+  StoragePtr Storage::to(const Device &device) const
+  {
+    auto copy = create(size_bytes_, device, alignment_);
+    if (device.is_meta())
+      return copy;
+    if (size_bytes_ == 0)
+      return copy;
+    auto *dst = static_cast<char *>(copy->mutable_data());
+    // A chunked clone's bytes live in two buffers; each chunk is in one of them
+    size_t step = chunks_ ? chunks_->chunk_bytes() : size_bytes_;
+    for (size_t offset = 0; offset < size_bytes_; offset += step)
+    {
+      size_t length = std::min(step, size_bytes_ - offset);
+      copy_between_devices(dst + offset, device, const_data(offset, length), device_, length);
+    }
+    return copy;
+  }
+
+  void Storage::materialize_on(const Device &device)
+  {
+    if (!is_meta())
+    {
+      throw std::runtime_error("Only Storages on the meta device can be materialized on another device");
+    }
+    if (device.is_meta())
+    {
+      throw std::invalid_argument("Cannot materialize a Storage on the meta device");
+    }
+    auto allocator = get_allocator(device);
+    deallocate();
+    bump_version();
+    device_ = device;
+    allocator_ = std::move(allocator);
+    capacity_bytes_ = size_bytes_;
+    if (fits_inline(size_bytes_))
+      data_ptr_ = DataPtr(inline_buffer_, nullptr, nullptr, device);
+    else if (size_bytes_ > 0)
+      allocate();
+  }
+
+  StoragePtr Storage::lazy_clone_chunked(Storage &src, size_t chunk_bytes)
+  {
+    if (chunk_bytes == 0 || chunk_bytes % page_size() != 0)
+    {
+      throw std::invalid_argument("COW chunk size must be a multiple of the page size");
+    }
+    if (src.size_bytes_ <= chunk_bytes || src.is_inline() || !src.device_.is_cpu() || src.alignment_ > page_size())
+      return lazy_clone(src);
+    if (src.is_chunked())
+      src.materialize();
+
+    auto source = cow::share_cow_data_ptr(src.data_ptr_);
+    auto clone = create_uninitialized(src.size_bytes_, src.device_, page_size());
+    clone->set_data_ptr(cow::ChunkedCOW::reserve_region(src.size_bytes_, src.device_));
+    clone->chunks_ = std::make_unique<cow::ChunkedCOW>(std::move(source), src.size_bytes_, chunk_bytes);
+    return clone;
+  }
+
+  void Storage::materialize_chunks()
+  {
+    chunks_->copy_in(data_ptr_.get(), 0, size_bytes_);
+    chunks_.reset();
+  }
+
+  void *Storage::data() const
+  {
+    if (chunks_)
+      return const_cast<void *>(const_data(0, size_bytes_));
+    return data_ptr_.get();
+  }
+
+  void Storage::make_writable()
+  {
+    if (is_cow())
+      materialize();
+    // Its pages are PROT_READ: trade it for a private copy, as for shared data
+    if (is_read_only_mapping(data_ptr_))
+      reallocate(size_bytes_);
+  }
+
+  void Storage::check_has_data() const
+  {
+    if (is_meta())
+    {
+      throw std::runtime_error("Storage on the meta device has no data; call materialize_on() first");
+    }
+  }
+
+  void Storage::check_range(size_t offset, size_t length) const
+  {
+    check_has_data();
+    if (offset > size_bytes_ || length > size_bytes_ - offset)
+    {
+      throw std::out_of_range("Storage range out of bounds");
+    }
+  }
+
+  const void *Storage::const_data() const
+  {
+    return const_data(0, size_bytes_);
+  }
+
+  void *Storage::mutable_data()
+  {
+    check_has_data();
+    bump_version();
+    make_writable();
+    return data_ptr_.get();
+  }
+
+  void *Storage::mutable_data(size_t offset, size_t length)
+  {
+    check_range(offset, length);
+    bump_version();
+    if (chunks_)
+    {
+      chunks_->copy_in(data_ptr_.get(), offset, length);
+      if (chunks_->complete())
+        chunks_.reset();
+    }
+    else
+    {
+      make_writable();
+    }
+    return static_cast<char *>(data_ptr_.get()) + offset;
+  }
+
+  const void *Storage::const_data(size_t offset, size_t length) const
+  {
+    check_range(offset, length);
+    if (chunks_)
+    {
+      if (chunks_->all_shared(offset, length))
+        return static_cast<const char *>(chunks_->source()) + offset;
+      if (!chunks_->all_owned(offset, length))
+      {
+        throw std::runtime_error("Range spans copied and shared chunks of a chunked COW clone; call materialize() first");
+      }
+    }
+    return static_cast<const char *>(data_ptr_.get()) + offset;
+  }
+
+  StoragePtr Storage::from_file(const std::string &path, size_t offset, size_t length, MapMode mode)
+  {
+    size_t mapped_length = 0;
+    auto data_ptr = map_file(path, offset, length, mode, &mapped_length);
+    auto storage = create_uninitialized(mapped_length, data_ptr.device(), data_ptr.alignment());
+    storage->set_data_ptr(std::move(data_ptr));
+    return storage;
+  }
+
+  void Storage::advise(MemoryAdvice advice) const
+  {
+    advise_memory(data_ptr_.get(), size_bytes_, advice);
+  }
+
+  bool Storage::is_shared() const
+  {
+    return owns_buffer() && allocator_ == get_shared_memory_allocator();
+  }
+
+  int Storage::share_memory()
+  {
+    auto shared_allocator = get_shared_memory_allocator();
+    if (!is_shared())
+    {
+      // Copies out of COW or mapped data too, leaving other owners untouched
+      if (chunks_)
+        materialize_chunks();
+      void *ptr = shared_allocator->allocate(size_bytes_, std::min(alignment_, page_size()));
+      if (data())
+        copy_bytes(ptr, data(), size_bytes_);
+      // Waits for recorded streams like any other buffer this Storage lets go of
+      deallocate();
+      allocator_ = shared_allocator;
+      alignment_ = page_size();
+      capacity_bytes_ = size_bytes_;
+      adopt_allocation(ptr);
+    }
+    return shared_allocator->fd_of(data());
+  }
+
+  StoragePtr Storage::from_shared_handle(int fd, size_t size_bytes)
+  {
+    auto shared_allocator = get_shared_memory_allocator();
+    void *ptr = shared_allocator->import(fd, size_bytes);
+    auto storage = create_uninitialized(size_bytes, Device(DeviceType::CPU), page_size());
+    storage->allocator_ = shared_allocator;
+    storage->adopt_allocation(ptr);
+    return storage;
+  }
+
   void Storage::materialize()
   {
-    cow::materialize_cow_storage(*this);
+    if (chunks_)
+      materialize_chunks();
+    else
+      cow::materialize_cow_storage(*this);
   }
 
   bool Storage::is_cow() const
   {
-    return cow::is_cow_data_ptr(*data_ptr_);
+    return chunks_ || cow::is_cow_data_ptr(data_ptr_);
   }
 
 } // namespace enigma
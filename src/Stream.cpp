@@ -0,0 +1,223 @@
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "Numa.h"
+#include "Stream.h"
+#include "DEBUG.h"
+
+namespace enigma
+{
+  struct Event::State
+  {
+    std::mutex mutex;
+    std::condition_variable done;
+    bool complete = false;
+    std::chrono::steady_clock::time_point time;
+
+    void mark()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      time = std::chrono::steady_clock::now();
+      complete = true;
+      done.notify_all();
+    }
+  };
+
+  // Queue and worker shared by a Stream and the Storages that recorded it.
+  // Once the Stream is gone, work launched here runs on the caller.
+  class StreamState
+  {
+  public:
+    void start(int numa_node)
+    {
+      worker_ = std::thread([this, numa_node]
+                            { run(numa_node); });
+    }
+
+    // Drains the queue and joins the worker
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      queued_.notify_one();
+      worker_.join();
+    }
+
+    void launch(std::function<void()> work)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopping_)
+        {
+          queue_.push_back(std::move(work));
+          submitted_++;
+          queued_.notify_one();
+          return;
+        }
+      }
+      work();
+    }
+
+    Event record()
+    {
+      Event event;
+      event.state_ = std::make_shared<Event::State>();
+      launch([state = event.state_]
+             { state->mark(); });
+      return event;
+    }
+
+    bool query() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return completed_ == submitted_;
+    }
+
+    std::exception_ptr synchronize()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      uint64_t target = submitted_;
+      finished_.wait(lock, [&]
+                     { return completed_ >= target; });
+      return std::exchange(error_, nullptr);
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable finished_;
+    std::deque<std::function<void()>> queue_;
+    uint64_t submitted_ = 0;
+    uint64_t completed_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::thread worker_;
+
+    void run(int numa_node)
+    {
+      if (numa_node >= 0)
+        numa::set_preferred_node(numa_node);
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;)
+      {
+        queued_.wait(lock, [this]
+                     { return stopping_ || !queue_.empty(); });
+        if (queue_.empty())
+          return;
+        std::function<void()> work = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        std::exception_ptr error;
+        try
+        {
+          work();
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+        // Whatever the work captured is released before it counts as done
+        work = nullptr;
+
+        lock.lock();
+        if (error && !error_)
+          error_ = error;
+        completed_++;
+        finished_.notify_all();
+      }
+    }
+  };
+
+  bool Event::query() const
+  {
+    if (!state_)
+      return true;
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->complete;
+  }
+
+  void Event::synchronize() const
+  {
+    if (!state_)
+      return;
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->done.wait(lock, [this]
+                      { return state_->complete; });
+  }
+
+  double Event::elapsed_ms(const Event &end) const
+  {
+    if (!state_ || !end.state_ || !query() || !end.query())
+    {
+      throw std::runtime_error("Both events must be recorded and complete");
+    }
+    return std::chrono::duration<double, std::milli>(end.state_->time - state_->time).count();
+  }
+
+  Stream::Stream(const Device &device) : device_(device), state_(std::make_shared<StreamState>())
+  {
+    if (!device.is_cpu())
+    {
+      throw std::invalid_argument("Streams are only supported on CPU devices, got " + device.to_string());
+    }
+    state_->start(device.has_index() && numa::is_available() ? device.index() : -1);
+  }
+
+  Stream::~Stream()
+  {
+    state_->stop();
+  }
+
+  void Stream::launch(std::function<void()> work)
+  {
+    if (!work)
+    {
+      throw std::invalid_argument("Stream work cannot be empty");
+    }
+    state_->launch(std::move(work));
+  }
+
+  Event Stream::record()
+  {
+    return state_->record();
+  }
+
+  void Stream::wait(const Event &event)
+  {
+    if (event.query())
+      return;
+    launch([event]
+           { event.synchronize(); });
+  }
+
+  bool Stream::query() const
+  {
+    return state_->query();
+  }
+
+  void Stream::synchronize()
+  {
+    if (std::exception_ptr error = state_->synchronize())
+      std::rethrow_exception(error);
+  }
+
+  void release_after_streams(const std::vector<std::weak_ptr<StreamState>> &streams,
+                             std::shared_ptr<void> resource)
+  {
+    for (const auto &weak : streams)
+    {
+      if (auto state = weak.lock())
+        state->launch([resource] {});
+    }
+  }
+
+} // namespace enigma
@@ -0,0 +1,368 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "Allocator.h"
+#include "CachingAllocator.h"
+#include "Device.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class CachingAllocatorTest : public ::testing::Test
+{
+protected:
+    Device cpu_device;
+    std::shared_ptr<CachingAllocator> allocator;
+
+    void SetUp() override
+    {
+        cpu_device = Device(DeviceType::CPU);
+        allocator = std::make_shared<CachingAllocator>(cpu_device);
+    }
+
+    void TearDown() override {}
+};
+
+// get_allocator hands out one process-wide instance
+TEST_F(CachingAllocatorTest, SingletonPerDevice)
+{
+    auto a = get_allocator(cpu_device);
+    auto b = get_allocator(cpu_device);
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_NE(dynamic_cast<CachingAllocator *>(a.get()), nullptr);
+}
+
+TEST_F(CachingAllocatorTest, SizeClasses)
+{
+    EXPECT_EQ(CachingAllocator::round_size(1), 64u);
+    EXPECT_EQ(CachingAllocator::round_size(64), 64u);
+    EXPECT_EQ(CachingAllocator::round_size(65), 128u);
+    EXPECT_EQ(CachingAllocator::round_size(1000), 1024u);
+    EXPECT_EQ(CachingAllocator::round_size(CachingAllocator::kSegmentSize), CachingAllocator::kSegmentSize);
+    EXPECT_EQ(CachingAllocator::round_size(CachingAllocator::kSegmentSize + 1), 2 * CachingAllocator::kSegmentSize);
+}
+
+// Freeing and re-allocating the same size class is a free-list pop
+TEST_F(CachingAllocatorTest, ReusesFreedBlocks)
+{
+    void *first = allocator->allocate(1000);
+    allocator->deallocate(first);
+    void *second = allocator->allocate(1000);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(allocator->reserved_bytes(), CachingAllocator::kSegmentSize);
+    allocator->deallocate(second);
+}
+
+TEST_F(CachingAllocatorTest, SplitAndCoalesce)
+{
+    // Two buddies split out of the same parent
+    void *a = allocator->allocate(2048);
+    void *b = allocator->allocate(2048);
+    EXPECT_EQ(static_cast<char *>(b) - static_cast<char *>(a), 2048);
+    EXPECT_EQ(allocator->allocated_bytes(), 4096u);
+
+    allocator->deallocate(a);
+    allocator->deallocate(b);
+    EXPECT_EQ(allocator->allocated_bytes(), 0u);
+
+    // Everything merged back, so a whole-segment block fits without growing
+    void *whole = allocator->allocate(CachingAllocator::kSegmentSize);
+    EXPECT_EQ(whole, a);
+    EXPECT_EQ(allocator->reserved_bytes(), CachingAllocator::kSegmentSize);
+    allocator->deallocate(whole);
+}
+
+TEST_F(CachingAllocatorTest, LargeBlocksAreCached)
+{
+    size_t large = 3 * CachingAllocator::kSegmentSize;
+    void *first = allocator->allocate(large);
+    allocator->deallocate(first);
+    void *second = allocator->allocate(large - 100);
+    EXPECT_EQ(first, second);
+    allocator->deallocate(second);
+}
+
+TEST_F(CachingAllocatorTest, EmptyCacheReleasesUnusedMemory)
+{
+    std::vector<void *> blocks;
+    for (int i = 0; i < 8; i++)
+    {
+        blocks.push_back(allocator->allocate(1 << 20));
+    }
+    void *large = allocator->allocate(2 * CachingAllocator::kSegmentSize);
+    void *kept = allocator->allocate(100);
+
+    for (void *block : blocks)
+    {
+        allocator->deallocate(block);
+    }
+    allocator->deallocate(large);
+
+    allocator->empty_cache();
+    // Only the segment still holding `kept` survives
+    EXPECT_EQ(allocator->reserved_bytes(), CachingAllocator::kSegmentSize);
+
+    allocator->deallocate(kept);
+    allocator->empty_cache();
+    EXPECT_EQ(allocator->reserved_bytes(), 0u);
+}
+
+TEST_F(CachingAllocatorTest, InvalidFreeThrows)
+{
+    void *ptr = allocator->allocate(256);
+    EXPECT_THROW(allocator->deallocate(static_cast<char *>(ptr) + 64), std::invalid_argument);
+    allocator->deallocate(ptr);
+    EXPECT_THROW(allocator->deallocate(ptr), std::invalid_argument);
+}
+
+// Storages round-trip through the shared allocator
+TEST_F(CachingAllocatorTest, StorageUsesCachingAllocator)
+{
+    void *first_data = nullptr;
+    {
+        Storage storage(4096, cpu_device);
+        std::memset(storage.data(), 7, 4096);
+        first_data = storage.data();
+    }
+    Storage storage(4096, cpu_device);
+    EXPECT_EQ(storage.data(), first_data);
+}
+
+// Every allocation honours the default 64-byte contract
+TEST_F(CachingAllocatorTest, DefaultAlignment)
+{
+    CPUAllocator system_allocator;
+    for (size_t size : {1, 24, 100, 5000})
+    {
+        void *cached = allocator->allocate(size);
+        void *system = system_allocator.allocate(size);
+        EXPECT_TRUE(is_aligned(cached, kDefaultAlignment));
+        EXPECT_TRUE(is_aligned(system, kDefaultAlignment));
+        allocator->deallocate(cached);
+        system_allocator.deallocate(system);
+    }
+}
+
+TEST_F(CachingAllocatorTest, PageAlignment)
+{
+    CPUAllocator system_allocator;
+    void *cached = allocator->allocate(100, page_size());
+    void *system = system_allocator.allocate(100, page_size());
+    EXPECT_TRUE(is_aligned(cached, page_size()));
+    EXPECT_TRUE(is_aligned(system, page_size()));
+    allocator->deallocate(cached);
+    system_allocator.deallocate(system);
+
+    EXPECT_THROW(allocator->allocate(100, 48), std::invalid_argument);
+    EXPECT_THROW(system_allocator.allocate(100, 0), std::invalid_argument);
+}
+
+TEST_F(CachingAllocatorTest, StorageAlignment)
+{
+    Storage storage(100, cpu_device);
+    EXPECT_EQ(storage.alignment(), kDefaultAlignment);
+    EXPECT_GE(storage.data_ptr().alignment(), kDefaultAlignment);
+    EXPECT_TRUE(is_aligned(storage.data(), storage.alignment()));
+
+    Storage paged(100, cpu_device, page_size());
+    EXPECT_EQ(paged.alignment(), page_size());
+    EXPECT_TRUE(is_aligned(paged.data(), page_size()));
+
+    EXPECT_THROW(Storage(100, cpu_device, 3), std::invalid_argument);
+}
+
+// Alignment survives cloning and materialization
+TEST_F(CachingAllocatorTest, CloneKeepsAlignment)
+{
+    Storage paged(1000, cpu_device, page_size());
+    auto clone = Storage::lazy_clone(paged);
+    EXPECT_EQ(clone->alignment(), page_size());
+
+    clone->materialize();
+    EXPECT_NE(clone->data(), paged.data());
+    EXPECT_EQ(clone->alignment(), page_size());
+    EXPECT_TRUE(is_aligned(clone->data(), page_size()));
+}
+
+// Requests at or above the huge page threshold get their own mapping
+TEST_F(CachingAllocatorTest, PagePolicyRoutesLargeRequests)
+{
+    EXPECT_FALSE(allocator->page_policy().applies_to(CachingAllocator::kSegmentSize));
+
+    PagePolicy policy;
+    policy.huge_page_threshold = kHugePageSize;
+    policy.prefault = Prefault::Populate;
+    allocator->set_page_policy(policy);
+
+    void *small = allocator->allocate(kHugePageSize / 2);
+    void *large = allocator->allocate(kHugePageSize);
+    EXPECT_EQ(allocator->reserved_bytes(), 2 * CachingAllocator::kSegmentSize);
+    EXPECT_TRUE(is_aligned(large, kHugePageSize));
+    static_cast<char *>(large)[kHugePageSize - 1] = 1;
+
+    allocator->deallocate(large);
+    void *reused = allocator->allocate(kHugePageSize);
+    EXPECT_EQ(reused, large);
+
+    allocator->deallocate(reused);
+    allocator->deallocate(small);
+}
+
+TEST_F(CachingAllocatorTest, PrefaultModes)
+{
+    for (Prefault mode : {Prefault::None, Prefault::Populate, Prefault::Lock})
+    {
+        PagePolicy policy;
+        policy.huge_page_threshold = 0;
+        policy.prefault = mode;
+        allocator->set_page_policy(policy);
+
+        auto *data = static_cast<char *>(allocator->allocate(kHugePageSize));
+        std::memset(data, 1, kHugePageSize);
+        allocator->deallocate(data);
+        allocator->empty_cache();
+    }
+    EXPECT_EQ(allocator->reserved_bytes(), 0u);
+}
+
+TEST_F(CachingAllocatorTest, StorageHugePages)
+{
+    Storage plain(kHugePageSize, cpu_device);
+    EXPECT_LE(plain.huge_page_bytes(), plain.size_bytes());
+
+    PagePolicy policy;
+    policy.huge_page_threshold = kHugePageSize;
+    policy.prefault = Prefault::Populate;
+    set_page_policy(cpu_device, policy);
+    {
+        Storage huge(kHugePageSize, cpu_device);
+        // The kernel may decline (THP disabled or no contiguous memory)
+        EXPECT_LE(huge.huge_page_bytes(), huge.size_bytes());
+        EXPECT_EQ(huge.huge_page_bytes() % kHugePageSize, 0u);
+    }
+    set_page_policy(cpu_device, PagePolicy());
+}
+
+TEST_F(CachingAllocatorTest, ReallocateInPlace)
+{
+    // Shrinking a buddy block splits it where it is
+    auto *block = static_cast<char *>(allocator->allocate(4096));
+    std::memset(block, 1, 4096);
+    EXPECT_EQ(allocator->reallocate(block, 4096, 1000), block);
+    EXPECT_EQ(allocator->allocated_bytes(), 1024u);
+    void *neighbour = allocator->allocate(1024);
+    EXPECT_EQ(neighbour, block + 1024);
+    allocator->deallocate(neighbour);
+
+    // Growing past the size class moves the data
+    auto *grown = static_cast<char *>(allocator->reallocate(block, 1000, 8192));
+    EXPECT_EQ(grown[999], 1);
+    EXPECT_EQ(allocator->allocated_bytes(), 8192u);
+
+    // Large blocks are trimmed or remapped without copying
+    size_t segment = CachingAllocator::kSegmentSize;
+    auto *large = static_cast<char *>(allocator->reallocate(grown, 8192, 2 * segment));
+    EXPECT_EQ(large[999], 1);
+    large[2 * segment - 1] = 2;
+    auto *larger = static_cast<char *>(allocator->reallocate(large, 2 * segment, 5 * segment));
+    EXPECT_EQ(larger[999], 1);
+    EXPECT_EQ(larger[2 * segment - 1], 2);
+    EXPECT_TRUE(is_aligned(larger, segment));
+    EXPECT_EQ(allocator->allocated_bytes(), 5 * segment);
+
+    auto *smaller = static_cast<char *>(allocator->reallocate(larger, 5 * segment, 3 * segment));
+    EXPECT_EQ(smaller, larger);
+    EXPECT_EQ(allocator->allocated_bytes(), 3 * segment);
+    allocator->deallocate(smaller);
+    allocator->empty_cache();
+    EXPECT_EQ(allocator->reserved_bytes(), 0u);
+}
+
+// A block freed on another thread goes back to the cache that handed it out
+TEST_F(CachingAllocatorTest, CrossThreadFree)
+{
+    std::vector<void *> blocks;
+    for (int i = 0; i < 32; i++)
+        blocks.push_back(allocator->allocate(256));
+
+    std::thread([&]
+                {
+                    for (void *block : blocks)
+                        allocator->deallocate(block);
+                })
+        .join();
+    EXPECT_EQ(allocator->allocated_bytes(), 0u);
+    EXPECT_THROW(allocator->deallocate(blocks[0]), std::invalid_argument);
+
+    void *again = allocator->allocate(256);
+    EXPECT_NE(std::find(blocks.begin(), blocks.end(), again), blocks.end());
+    allocator->deallocate(again);
+
+    allocator->empty_cache();
+    EXPECT_EQ(allocator->reserved_bytes(), 0u);
+}
+
+// An exiting thread hands its cached blocks back
+TEST_F(CachingAllocatorTest, ThreadExitFlushesCache)
+{
+    std::thread([&]
+                {
+                    std::vector<void *> blocks;
+                    for (int i = 0; i < 100; i++)
+                        blocks.push_back(allocator->allocate(64 << (i % 8)));
+                    for (void *block : blocks)
+                        allocator->deallocate(block);
+                })
+        .join();
+    EXPECT_EQ(allocator->allocated_bytes(), 0u);
+    allocator->empty_cache();
+    EXPECT_EQ(allocator->reserved_bytes(), 0u);
+}
+
+TEST_F(CachingAllocatorTest, ConcurrentAllocateAndFree)
+{
+    constexpr int kThreads = 4;
+    constexpr int kBlocks = 2000;
+    std::vector<std::vector<char *>> handoff(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+                                 for (int i = 0; i < kBlocks; i++)
+                                 {
+                                     size_t size = 16 << (i % 10);
+                                     auto *block = static_cast<char *>(allocator->allocate(size));
+                                     std::memset(block, t, size);
+                                     if (i % 2)
+                                         allocator->deallocate(block);
+                                     else
+                                         handoff[t].push_back(block);
+                                 }
+                             });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    threads.clear();
+
+    // Free every thread's leftovers on a different thread
+    for (int t = 0; t < kThreads; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+                                 for (char *block : handoff[(t + 1) % kThreads])
+                                 {
+                                     EXPECT_EQ(block[0], static_cast<char>((t + 1) % kThreads));
+                                     allocator->deallocate(block);
+                                 }
+                             });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(allocator->allocated_bytes(), 0u);
+    allocator->empty_cache();
+    EXPECT_EQ(allocator->reserved_bytes(), 0u);
+}
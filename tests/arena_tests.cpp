@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "Allocator.h"
+#include "Arena.h"
+#include "COW.h"
+#include "Device.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class ArenaTest : public ::testing::Test
+{
+protected:
+    Device cpu_device;
+
+    void SetUp() override
+    {
+        cpu_device = Device(DeviceType::CPU);
+    }
+};
+
+TEST_F(ArenaTest, BumpAllocation)
+{
+    ArenaAllocator arena(cpu_device, 4096);
+    char *a = static_cast<char *>(arena.allocate(100));
+    char *b = static_cast<char *>(arena.allocate(100));
+    EXPECT_TRUE(is_aligned(a, kDefaultAlignment));
+    EXPECT_TRUE(is_aligned(b, kDefaultAlignment));
+    EXPECT_EQ(b - a, 128); // next 64-byte boundary
+    EXPECT_EQ(arena.used_bytes(), 228u);
+
+    char *paged = static_cast<char *>(arena.allocate(10, page_size()));
+    EXPECT_TRUE(is_aligned(paged, page_size()));
+}
+
+TEST_F(ArenaTest, ResetRewindsInConstantTime)
+{
+    ArenaAllocator arena(cpu_device, 4096);
+    void *first = arena.allocate(1000);
+    for (int i = 0; i < 20; i++)
+    {
+        arena.allocate(1000); // spills into several chunks
+    }
+    size_t capacity = arena.capacity_bytes();
+    EXPECT_GT(capacity, 4096u);
+
+    arena.reset();
+    EXPECT_EQ(arena.used_bytes(), 0u);
+    EXPECT_EQ(arena.allocate(1000), first);
+
+    // Chunks are kept, so replaying the same pattern does not grow the arena
+    for (int i = 0; i < 20; i++)
+    {
+        arena.allocate(1000);
+    }
+    EXPECT_EQ(arena.capacity_bytes(), capacity);
+
+    arena.release();
+    EXPECT_EQ(arena.capacity_bytes(), 0u);
+}
+
+TEST_F(ArenaTest, OversizedRequestGetsDedicatedChunk)
+{
+    ArenaAllocator arena(cpu_device, 4096);
+    arena.allocate(100);
+    char *big = static_cast<char *>(arena.allocate(64 * 1024));
+    std::memset(big, 1, 64 * 1024);
+    EXPECT_GE(arena.capacity_bytes(), 4096u + 64 * 1024);
+}
+
+// Storages created inside a scope bump-allocate and are reclaimed on exit
+TEST_F(ArenaTest, ScopeRoutesStorageAllocations)
+{
+    EXPECT_EQ(ArenaScope::current(), nullptr);
+    void *first = nullptr;
+    {
+        ArenaScope scope;
+        EXPECT_EQ(ArenaScope::current().get(), &scope.arena());
+        EXPECT_EQ(get_allocator(cpu_device).get(), &scope.arena());
+
+        Storage a(256, cpu_device);
+        Storage b(256, cpu_device);
+        first = a.data();
+        EXPECT_EQ(static_cast<char *>(b.data()) - static_cast<char *>(a.data()), 256);
+        EXPECT_GE(scope.arena().used_bytes(), 512u);
+    }
+    EXPECT_EQ(ArenaScope::current(), nullptr);
+    EXPECT_EQ(dynamic_cast<ArenaAllocator *>(get_allocator(cpu_device).get()), nullptr);
+
+    {
+        // The per-thread arena was rewound, so the same memory comes back
+        ArenaScope scope;
+        Storage again(256, cpu_device);
+        EXPECT_EQ(again.data(), first);
+    }
+}
+
+TEST_F(ArenaTest, NestedScopes)
+{
+    auto arena = std::make_shared<ArenaAllocator>(cpu_device, 1 << 16);
+    ArenaScope outer(arena);
+    Storage kept(128, cpu_device);
+    std::memset(kept.data(), 7, 128);
+    size_t used = arena->used_bytes();
+
+    {
+        ArenaScope inner(arena);
+        Storage scratch(4096, cpu_device);
+        std::memset(scratch.data(), 9, 4096);
+        EXPECT_GT(arena->used_bytes(), used);
+    }
+
+    // Inner scope released only its own allocations
+    EXPECT_EQ(arena->used_bytes(), used);
+    EXPECT_EQ(static_cast<unsigned char *>(kept.data())[127], 7);
+    EXPECT_EQ(ArenaScope::current(), arena);
+}
+
+TEST_F(ArenaTest, CloneAndMaterializeInScope)
+{
+    ArenaScope scope;
+    Storage original(1000, cpu_device);
+    std::memset(original.data(), 1, 1000);
+
+    auto clone = cow::lazy_clone_storage(original);
+    cow::materialize_cow_storage(*clone);
+    std::memset(clone->data(), 2, 1000);
+
+    EXPECT_EQ(static_cast<unsigned char *>(original.data())[0], 1);
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[0], 2);
+    EXPECT_EQ(clone->allocator().get(), &scope.arena());
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "Allocator.h"
+#include "Backend.h"
+#include "MemoryStats.h"
+#include "SimulatedAccelerator.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+namespace
+{
+    // Plain malloc memory that counts its traffic
+    class CountingBackend : public Backend
+    {
+    public:
+        static inline std::atomic<int> copies{0};
+
+        DeviceType type() const override { return DeviceType::PRIVATE_USE; }
+        std::shared_ptr<Allocator> allocator(const Device &) override { return allocator_; }
+        void copy(void *dst, const Device &, const void *src, const Device &, size_t num_bytes) override
+        {
+            copies++;
+            std::memcpy(dst, src, num_bytes);
+        }
+
+    private:
+        std::shared_ptr<Allocator> allocator_ = std::make_shared<CPUAllocator>();
+    };
+} // namespace
+
+class BackendTest : public ::testing::Test
+{
+};
+
+TEST_F(BackendTest, BuiltInBackends)
+{
+    EXPECT_TRUE(has_backend(DeviceType::CPU));
+    EXPECT_TRUE(has_backend(DeviceType::SIM));
+    EXPECT_FALSE(has_backend(DeviceType::CUDA));
+    EXPECT_EQ(get_backend(DeviceType::CPU).allocator(Device(DeviceType::CPU)),
+              get_device_allocator(Device(DeviceType::CPU)));
+    EXPECT_THROW(get_backend(DeviceType::CUDA), std::invalid_argument);
+    EXPECT_THROW(Storage(16, Device(DeviceType::CUDA)), std::invalid_argument);
+
+    Device sim("sim:0");
+    EXPECT_EQ(sim.type(), DeviceType::SIM);
+    EXPECT_EQ(sim.to_string(), "SIM:0");
+    EXPECT_EQ(Device("sim").index(), -1);
+    EXPECT_THROW(Device("simx"), std::invalid_argument);
+}
+
+// SIM memory comes from its own pool and is accounted to the SIM device
+TEST_F(BackendTest, SimulatedAcceleratorPool)
+{
+    Device sim(DeviceType::SIM);
+    auto sim_allocator = get_allocator(sim);
+    EXPECT_NE(sim_allocator, get_allocator(Device(DeviceType::CPU)));
+    EXPECT_EQ(sim_allocator->device(), sim);
+
+    int64_t before = memory_stats(sim).current_bytes;
+    {
+        Storage storage(1 << 16, sim);
+        EXPECT_EQ(storage.device(), sim);
+        EXPECT_FALSE(storage.is_inline());
+        EXPECT_GE(memory_stats(sim).current_bytes, before + (1 << 16));
+    }
+    EXPECT_EQ(memory_stats(sim).current_bytes, before);
+}
+
+TEST_F(BackendTest, TransfersRoundTrip)
+{
+    Storage host(1 << 20, Device(DeviceType::CPU));
+    std::memset(host.mutable_data(), 7, host.size_bytes());
+
+    auto device_copy = host.to(Device(DeviceType::SIM));
+    EXPECT_EQ(device_copy->device().type(), DeviceType::SIM);
+    EXPECT_NE(device_copy->const_data(), host.const_data());
+    auto back = device_copy->to(Device(DeviceType::CPU));
+    EXPECT_EQ(back->device(), Device(DeviceType::CPU));
+    EXPECT_EQ(std::memcmp(back->const_data(), host.const_data(), host.size_bytes()), 0);
+}
+
+TEST_F(BackendTest, AsyncCopiesCompleteInOrder)
+{
+    auto &sim = simulated_accelerator();
+    sim.set_link(1e9, std::chrono::microseconds(200)); // 1 GB/s, 200us per transfer
+
+    Device device(DeviceType::SIM);
+    std::vector<char> src(1 << 20, 3);
+    Storage a(src.size(), device), b(src.size(), device);
+    CopyTicket first = sim.copy_async(a.mutable_data(), device, src.data(), Device(DeviceType::CPU), src.size());
+    CopyTicket second = sim.copy_async(b.mutable_data(), device, a.const_data(), device, src.size());
+    EXPECT_GT(second, first);
+    EXPECT_FALSE(sim.is_complete(second));
+
+    sim.wait(second);
+    EXPECT_TRUE(sim.is_complete(first));
+    EXPECT_EQ(static_cast<const char *>(b.const_data())[src.size() - 1], 3);
+    sim.synchronize();
+    sim.set_link(0);
+    EXPECT_THROW(sim.set_link(-1), std::invalid_argument);
+}
+
+// A new device type plugs in without touching get_allocator()
+TEST_F(BackendTest, RegisterCustomBackend)
+{
+    register_backend(std::make_unique<CountingBackend>());
+    EXPECT_THROW(register_backend(std::make_unique<CountingBackend>()), std::invalid_argument);
+    EXPECT_THROW(register_backend(nullptr), std::invalid_argument);
+
+    Device custom(DeviceType::PRIVATE_USE);
+    Storage storage(4096, custom);
+    EXPECT_EQ(storage.allocator(), get_backend(DeviceType::PRIVATE_USE).allocator(custom));
+
+    Storage host(4096, Device(DeviceType::CPU));
+    std::memset(host.mutable_data(), 9, 4096);
+    auto moved = host.to(custom);
+    EXPECT_EQ(CountingBackend::copies.load(), 1);
+    EXPECT_EQ(static_cast<const unsigned char *>(moved->const_data())[4095], 9);
+}
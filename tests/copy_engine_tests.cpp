@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "CopyEngine.h"
+#include "COW.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class CopyEngineTest : public ::testing::Test
+{
+protected:
+    int saved_threads;
+
+    void SetUp() override
+    {
+        saved_threads = copy_threads();
+    }
+
+    void TearDown() override
+    {
+        set_copy_threads(saved_threads);
+    }
+
+    static std::vector<uint8_t> pattern(size_t size)
+    {
+        std::vector<uint8_t> bytes(size);
+        for (size_t i = 0; i < size; i++)
+            bytes[i] = static_cast<uint8_t>(i * 31 + i / 4096);
+        return bytes;
+    }
+};
+
+// Sizes and offsets around the thresholds, with odd alignments on both sides
+TEST_F(CopyEngineTest, CopiesExactly)
+{
+    size_t llc = last_level_cache_bytes();
+    EXPECT_GT(llc, 0u);
+    for (size_t size : {size_t{0}, size_t{1}, size_t{4095}, kParallelCopyThreshold - 1, kParallelCopyThreshold + 77,
+                        llc + 4097})
+    {
+        auto src = pattern(size + 3);
+        std::vector<uint8_t> dst(size + 5, 0xEE);
+        copy_bytes(dst.data() + 5, src.data() + 3, size);
+        EXPECT_EQ(std::memcmp(dst.data() + 5, src.data() + 3, size), 0) << size;
+        EXPECT_EQ(dst[4], 0xEE);
+    }
+}
+
+TEST_F(CopyEngineTest, ThreadSetting)
+{
+    set_copy_threads(1);
+    EXPECT_EQ(copy_threads(), 1);
+    auto src = pattern(3 * kParallelCopyThreshold);
+    std::vector<uint8_t> dst(src.size());
+    copy_bytes(dst.data(), src.data(), src.size());
+    EXPECT_EQ(dst, src);
+
+    set_copy_threads(1 << 20); // capped at the hardware
+    EXPECT_GE(copy_threads(), 1);
+    EXPECT_THROW(set_copy_threads(0), std::invalid_argument);
+}
+
+// Materializing a large COW clone goes through the engine
+TEST_F(CopyEngineTest, MaterializeLargeClone)
+{
+    size_t size = 2 * kParallelCopyThreshold + 123;
+    Storage original(size, Device(DeviceType::CPU));
+    auto bytes = pattern(size);
+    std::memcpy(original.data(), bytes.data(), size);
+
+    auto clone = Storage::lazy_clone(original);
+    clone->materialize();
+    EXPECT_NE(clone->data(), original.data());
+    EXPECT_EQ(std::memcmp(clone->data(), bytes.data(), size), 0);
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "Allocator.h"
+#include "Device.h"
+#include "DeviceType.h"
+#include "Numa.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class DeviceTest : public ::testing::Test
+{
+};
+
+TEST_F(DeviceTest, ParseCPUStrings)
+{
+    Device plain("cpu");
+    EXPECT_TRUE(plain.is_cpu());
+    EXPECT_EQ(plain.index(), -1);
+    EXPECT_EQ(plain, Device(DeviceType::CPU));
+
+    Device node("cpu:1");
+    EXPECT_TRUE(node.is_cpu());
+    EXPECT_EQ(node.index(), 1);
+    EXPECT_EQ(node.to_string(), "CPU:1");
+
+    EXPECT_THROW(Device("cpu:-2"), std::invalid_argument);
+    EXPECT_THROW(Device("cpu:"), std::invalid_argument);
+    EXPECT_THROW(Device("cpu:1x"), std::invalid_argument);
+    EXPECT_THROW(Device("cpux"), std::invalid_argument);
+    EXPECT_THROW(Device("tpu"), std::invalid_argument);
+}
+
+TEST_F(DeviceTest, CPUIndexNamesNumaNode)
+{
+    Device node(DeviceType::CPU, 3);
+    EXPECT_EQ(node.index(), 3);
+    EXPECT_TRUE(node.has_index());
+    EXPECT_NE(node, Device(DeviceType::CPU));
+    EXPECT_THROW(Device(DeviceType::CPU, -5), std::invalid_argument);
+}
+
+TEST_F(DeviceTest, NumaTopology)
+{
+    EXPECT_GE(numa::num_nodes(), 1);
+    EXPECT_EQ(numa::is_available(), numa::num_nodes() > 1);
+}
+
+// Storage on node 0 works everywhere, and its touched pages are reported
+TEST_F(DeviceTest, NodeBoundStorage)
+{
+    Storage storage(1 << 20, Device(DeviceType::CPU, 0));
+    EXPECT_EQ(storage.device().index(), 0);
+    std::memset(storage.data(), 1, storage.size_bytes());
+
+    auto nodes = numa::page_nodes(storage.data(), storage.size_bytes());
+    EXPECT_EQ(nodes.size(), (storage.size_bytes() + page_size() - 1) / page_size());
+
+    int node = storage.numa_node();
+    if (numa::is_available())
+    {
+        EXPECT_EQ(node, 0);
+    }
+    else
+    {
+        EXPECT_TRUE(node == 0 || node == -1); // -1 when the kernel lacks move_pages
+    }
+}
+
+// Nodes beyond the topology fall back on single-node machines and are
+// rejected where placement is real
+TEST_F(DeviceTest, OutOfRangeNode)
+{
+    Device far_node(DeviceType::CPU, numa::num_nodes());
+    if (numa::is_available())
+    {
+        EXPECT_THROW(get_allocator(far_node), std::invalid_argument);
+    }
+    else
+    {
+        EXPECT_EQ(get_allocator(far_node).get(), get_allocator(Device(DeviceType::CPU)).get());
+        Storage storage(64, far_node);
+        EXPECT_NE(storage.data(), nullptr);
+    }
+}
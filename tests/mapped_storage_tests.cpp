@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "COW.h"
+#include "MappedFile.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class MappedStorageTest : public ::testing::Test
+{
+protected:
+    std::string path;
+    std::vector<unsigned char> contents;
+
+    void SetUp() override
+    {
+        path = "/tmp/enigma_mapped_" + std::to_string(getpid()) + ".bin";
+        contents.resize(3 * 4096 + 123);
+        for (size_t i = 0; i < contents.size(); i++)
+        {
+            contents[i] = static_cast<unsigned char>(i % 251);
+        }
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+    }
+
+    void TearDown() override
+    {
+        std::remove(path.c_str());
+    }
+
+    std::vector<unsigned char> read_back()
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), {});
+    }
+};
+
+TEST_F(MappedStorageTest, MapsWholeFile)
+{
+    auto storage = Storage::from_file(path);
+    ASSERT_EQ(storage->size_bytes(), contents.size());
+    EXPECT_EQ(std::memcmp(storage->data(), contents.data(), contents.size()), 0);
+    EXPECT_TRUE(is_aligned(storage->data(), page_size()));
+}
+
+TEST_F(MappedStorageTest, UnalignedOffsetAndLength)
+{
+    auto storage = Storage::from_file(path, 4096 + 17, 5000);
+    ASSERT_EQ(storage->size_bytes(), 5000u);
+    EXPECT_EQ(std::memcmp(storage->data(), contents.data() + 4096 + 17, 5000), 0);
+}
+
+// Private mappings accept writes without touching the file
+TEST_F(MappedStorageTest, PrivateModeIsCopyOnWrite)
+{
+    {
+        auto storage = Storage::from_file(path, 0, 0, MapMode::Private);
+        std::memset(storage->data(), 0xAB, 100);
+        EXPECT_EQ(static_cast<unsigned char *>(storage->data())[0], 0xAB);
+    }
+    EXPECT_EQ(read_back(), contents);
+}
+
+// Mapped storages participate in lazy cloning and survive their origin
+TEST_F(MappedStorageTest, LazyCloneOfMapping)
+{
+    auto storage = Storage::from_file(path);
+    auto clone = cow::lazy_clone_storage(*storage);
+    auto reader = cow::lazy_clone_storage(*storage);
+    EXPECT_EQ(clone->data(), storage->data());
+
+    storage.reset(); // mapping stays alive through the clones
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[4096], contents[4096]);
+
+    // Materializing a shared read-only mapping yields a writable heap copy
+    clone->materialize();
+    std::memset(clone->data(), 1, 10);
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[10], contents[10]);
+    EXPECT_EQ(static_cast<unsigned char *>(reader->data())[0], contents[0]);
+}
+
+// Read-only pages are never handed out for writing
+TEST_F(MappedStorageTest, MutableDataCopiesReadOnlyMapping)
+{
+    auto storage = Storage::from_file(path);
+    const void *mapped = storage->data();
+    auto *bytes = static_cast<unsigned char *>(storage->mutable_data());
+    EXPECT_NE(bytes, mapped);
+    bytes[0] = 0xCD;
+    EXPECT_EQ(bytes[1], contents[1]);
+    EXPECT_EQ(storage->size_bytes(), contents.size());
+
+    // A clone left holding the mapping alone copies it too
+    auto original = Storage::from_file(path, 4096);
+    auto clone = cow::lazy_clone_storage(*original);
+    original.reset();
+    std::memset(clone->mutable_data(10, 5), 0xEF, 5);
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[10], 0xEF);
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[0], contents[4096]);
+
+    EXPECT_EQ(read_back(), contents);
+}
+
+TEST_F(MappedStorageTest, Advice)
+{
+    auto storage = Storage::from_file(path, 100);
+    EXPECT_NO_THROW(storage->advise(MemoryAdvice::Sequential));
+    EXPECT_NO_THROW(storage->advise(MemoryAdvice::Random));
+    EXPECT_NO_THROW(storage->advise(MemoryAdvice::WillNeed));
+    EXPECT_NO_THROW(storage->advise(MemoryAdvice::Normal));
+}
+
+TEST_F(MappedStorageTest, Errors)
+{
+    EXPECT_THROW(Storage::from_file(path + ".missing"), std::system_error);
+    EXPECT_THROW(Storage::from_file(path, contents.size() + 1), std::out_of_range);
+    EXPECT_THROW(Storage::from_file(path, 10, contents.size()), std::out_of_range);
+}
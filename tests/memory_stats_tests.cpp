@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "CachingAllocator.h"
+#include "Device.h"
+#include "MemoryStats.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+// Each test uses its own CPU index so counters start from a clean slot
+class MemoryStatsTest : public ::testing::Test
+{
+protected:
+    static Device device_for(int index)
+    {
+        return Device(DeviceType::CPU, index);
+    }
+};
+
+TEST_F(MemoryStatsTest, CountsAllocationsAndFrees)
+{
+    Device device = device_for(11);
+    CachingAllocator allocator(device);
+
+    void *a = allocator.allocate(1000); // 1024-byte class
+    void *b = allocator.allocate(64);
+
+    MemoryStats stats = memory_stats(device);
+    EXPECT_EQ(stats.current_bytes, 1024 + 64);
+    EXPECT_EQ(stats.allocation_count, 2);
+    EXPECT_EQ(stats.free_count, 0);
+    EXPECT_EQ(stats.reserved_bytes, static_cast<int64_t>(CachingAllocator::kSegmentSize));
+    EXPECT_EQ(stats.cached_bytes, stats.reserved_bytes - stats.current_bytes);
+    EXPECT_EQ(stats.size_histogram[10], 1); // (512, 1024]
+    EXPECT_EQ(stats.size_histogram[6], 1);  // (32, 64]
+
+    allocator.deallocate(a);
+    allocator.deallocate(b);
+    stats = memory_stats(device);
+    EXPECT_EQ(stats.current_bytes, 0);
+    EXPECT_EQ(stats.free_count, 2);
+    EXPECT_EQ(stats.cached_bytes, stats.reserved_bytes);
+
+    allocator.empty_cache();
+    EXPECT_EQ(memory_stats(device).reserved_bytes, 0);
+}
+
+TEST_F(MemoryStatsTest, PeakTracking)
+{
+    Device device = device_for(12);
+    CachingAllocator allocator(device);
+
+    std::vector<void *> blocks;
+    for (int i = 0; i < 8; i++)
+    {
+        blocks.push_back(allocator.allocate(1 << 20));
+    }
+    for (void *block : blocks)
+    {
+        allocator.deallocate(block);
+    }
+
+    MemoryStats stats = memory_stats(device);
+    EXPECT_EQ(stats.current_bytes, 0);
+    EXPECT_GE(stats.peak_bytes, 8 * (1 << 20) - stats::kPeakFlushBytes);
+    EXPECT_LE(stats.peak_bytes, 8 * (1 << 20));
+
+    reset_peak_memory_stats(device);
+    EXPECT_LE(memory_stats(device).peak_bytes, stats::kPeakFlushBytes);
+}
+
+// Counters recorded on other threads, including exited ones, are aggregated
+TEST_F(MemoryStatsTest, AggregatesAcrossThreads)
+{
+    Device device = device_for(13);
+    CachingAllocator allocator(device);
+
+    std::vector<void *> blocks(4);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++)
+    {
+        workers.emplace_back([&, t]
+                             { blocks[t] = allocator.allocate(4096); });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    MemoryStats stats = memory_stats(device);
+    EXPECT_EQ(stats.allocation_count, 4);
+    EXPECT_EQ(stats.current_bytes, 4 * 4096);
+
+    // Free on a different thread than the one that allocated
+    for (void *block : blocks)
+    {
+        allocator.deallocate(block);
+    }
+    stats = memory_stats(device);
+    EXPECT_EQ(stats.free_count, 4);
+    EXPECT_EQ(stats.current_bytes, 0);
+}
+
+// A device without an index sums every index of its type
+TEST_F(MemoryStatsTest, IndexlessQueryAggregates)
+{
+    CachingAllocator first(device_for(14));
+    CachingAllocator second(device_for(15));
+    MemoryStats before = memory_stats(Device(DeviceType::CPU));
+
+    void *a = first.allocate(128);
+    void *b = second.allocate(256);
+    MemoryStats after = memory_stats(Device(DeviceType::CPU));
+    EXPECT_EQ(after.allocation_count - before.allocation_count, 2);
+    EXPECT_EQ(after.current_bytes - before.current_bytes, 128 + 256);
+
+    first.deallocate(a);
+    second.deallocate(b);
+}
+
+TEST_F(MemoryStatsTest, StorageIsAccounted)
+{
+    Device cpu(DeviceType::CPU);
+    MemoryStats before = memory_stats(cpu);
+    {
+        Storage storage(3000, cpu);
+        MemoryStats during = memory_stats(cpu);
+        EXPECT_EQ(during.current_bytes - before.current_bytes, 4096);
+        EXPECT_EQ(during.allocation_count - before.allocation_count, 1);
+    }
+    MemoryStats after = memory_stats(cpu);
+    EXPECT_EQ(after.current_bytes, before.current_bytes);
+    EXPECT_EQ(after.free_count - before.free_count, 1);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "MemoryStats.h"
+#include "Snapshot.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class MetaStorageTest : public ::testing::Test
+{
+protected:
+    Device meta_device = Device(DeviceType::META);
+    Device cpu_device = Device(DeviceType::CPU);
+};
+
+TEST_F(MetaStorageTest, DeviceParsing)
+{
+    Device device("meta");
+    EXPECT_TRUE(device.is_meta());
+    EXPECT_EQ(device.to_string(), "META");
+    EXPECT_THROW(Device("meta:0"), std::invalid_argument);
+}
+
+// Sizes, not memory: even 100 GB of parameters are free to "allocate"
+TEST_F(MetaStorageTest, AllocatesNothing)
+{
+    int64_t cpu_before = memory_stats(cpu_device).current_bytes;
+    int64_t meta_before = memory_stats(meta_device).current_bytes;
+    {
+        std::vector<StoragePtr> parameters;
+        for (int i = 0; i < 100; i++)
+            parameters.push_back(Storage::create(size_t(1) << 30, meta_device));
+        parameters.push_back(Storage::create(16, meta_device));
+
+        EXPECT_TRUE(parameters[0]->is_meta());
+        EXPECT_EQ(parameters[0]->size_bytes(), size_t(1) << 30);
+        EXPECT_EQ(parameters[0]->data(), nullptr);
+        EXPECT_FALSE(parameters.back()->is_inline());
+        EXPECT_EQ(memory_stats(meta_device).current_bytes, meta_before + 100 * (int64_t(1) << 30) + 16);
+        EXPECT_EQ(memory_stats(cpu_device).current_bytes, cpu_before);
+
+        EXPECT_THROW(parameters[0]->const_data(), std::runtime_error);
+        EXPECT_THROW(parameters[0]->mutable_data(), std::runtime_error);
+        EXPECT_THROW(parameters[0]->mutable_data(0, 8), std::runtime_error);
+    }
+    EXPECT_EQ(memory_stats(meta_device).current_bytes, meta_before);
+    EXPECT_GE(memory_stats(meta_device).peak_bytes, meta_before + 100 * (int64_t(1) << 30));
+}
+
+TEST_F(MetaStorageTest, ResizeCloneAndTransfer)
+{
+    int64_t before = memory_stats(meta_device).current_bytes;
+    auto storage = Storage::create(1000, meta_device);
+    storage->resize(5000);
+    EXPECT_EQ(storage->size_bytes(), 5000u);
+    EXPECT_GE(storage->capacity_bytes(), 5000u);
+    EXPECT_EQ(memory_stats(meta_device).current_bytes, before + static_cast<int64_t>(storage->capacity_bytes()));
+
+    auto clone = Storage::lazy_clone(*storage);
+    EXPECT_TRUE(clone->is_meta());
+    EXPECT_EQ(clone->size_bytes(), 5000u);
+
+    Storage host(256, cpu_device);
+    auto on_meta = host.to(meta_device);
+    EXPECT_TRUE(on_meta->is_meta());
+    EXPECT_EQ(on_meta->size_bytes(), 256u);
+    EXPECT_THROW(storage->to(cpu_device), std::runtime_error);
+}
+
+// Everything holding the Storage sees the real buffer afterwards
+TEST_F(MetaStorageTest, MaterializeOn)
+{
+    int64_t before = memory_stats(meta_device).current_bytes;
+    auto large = Storage::create(1 << 20, meta_device, 4096);
+    auto small = Storage::create(32, meta_device);
+    Snapshotter snapshotter({large, small});
+    uint64_t version = large->version();
+
+    large->materialize_on(cpu_device);
+    small->materialize_on(cpu_device);
+    EXPECT_EQ(memory_stats(meta_device).current_bytes, before);
+    EXPECT_GT(large->version(), version);
+
+    ASSERT_EQ(snapshotter.storages()[0], large);
+    EXPECT_EQ(large->device(), cpu_device);
+    EXPECT_EQ(large->size_bytes(), 1u << 20);
+    EXPECT_TRUE(is_aligned(large->const_data(), 4096));
+    EXPECT_TRUE(small->is_inline());
+    std::memset(large->mutable_data(), 5, 1 << 20);
+    EXPECT_EQ(static_cast<const unsigned char *>(large->const_data())[12345], 5);
+
+    EXPECT_THROW(large->materialize_on(cpu_device), std::runtime_error);
+    auto other = Storage::create(8, meta_device);
+    EXPECT_THROW(other->materialize_on(meta_device), std::invalid_argument);
+}
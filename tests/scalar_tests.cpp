@@ -26,10 +26,11 @@ TEST_F(ScalarTest, DefaultConstruction)
 
 TEST_F(ScalarTest, TypeConstruction)
 {
-    // Integer construction
+    // Integer construction keeps the width of the C++ type
     Scalar s1(42);
-    EXPECT_EQ(s1.type(), ScalarType::Int64);
+    EXPECT_EQ(s1.type(), ScalarType::Int32);
     EXPECT_EQ(s1.to<int64_t>(), 42);
+    EXPECT_EQ(Scalar(int64_t(42)).type(), ScalarType::Int64);
 
     // Float construction
     Scalar s2(3.14);
@@ -281,7 +282,13 @@ TEST_F(ScalarTest, TypePromotion)
     EXPECT_EQ(Scalar::promoteTypes(ScalarType::Float64, ScalarType::Complex64),
               ScalarType::Complex128);
     EXPECT_EQ(Scalar::promoteTypes(ScalarType::Int64, ScalarType::Complex64),
-              ScalarType::Complex128);
+              ScalarType::Complex64);
+    EXPECT_EQ(Scalar::promoteTypes(ScalarType::Float32, ScalarType::Complex64),
+              ScalarType::Complex64);
+    EXPECT_EQ(Scalar::promoteTypes(ScalarType::Int32, ScalarType::Complex64),
+              ScalarType::Complex64);
+    EXPECT_EQ(Scalar::promoteTypes(ScalarType::Int64, ScalarType::Float32),
+              ScalarType::Float32);
 
     // Float promotion
     EXPECT_EQ(Scalar::promoteTypes(ScalarType::Int64, ScalarType::Float64),
@@ -366,23 +373,75 @@ TEST_F(ScalarTest, MemorySafety)
     EXPECT_EQ(copy.to<int64_t>(), 43);
 }
 
-// Performance Tests (Basic)
-TEST_F(ScalarTest, BasicPerformance)
+// Every (lhs, rhs) pair goes through its own kernel; check the result types
+TEST_F(ScalarTest, ArithmeticResultTypes)
 {
-    const int iterations = 1000000;
-
-    // Measure time for basic operations
-    auto start = std::chrono::high_resolution_clock::now();
-
-    Scalar s(1.0);
-    for (int i = 0; i < iterations; ++i)
-    {
-        s = s + Scalar(1.0);
-    }
-
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    Scalar i(int64_t(6)), u(uint64_t(4)), f(1.5), b(true);
+    Scalar c64(std::complex<float>(1.0f, 1.0f)), c128(std::complex<double>(2.0, 0.0));
+
+    EXPECT_EQ((i + u).type(), ScalarType::UInt64);
+    EXPECT_EQ((u * u).to<uint64_t>(), 16u);
+    EXPECT_EQ((i - b).to<int64_t>(), 5);
+    EXPECT_EQ((b + f).type(), ScalarType::Float64);
+    EXPECT_EQ((c64 * c64).type(), ScalarType::Complex64);
+    EXPECT_EQ((c64 * c64).to<std::complex<double>>(), std::complex<double>(0.0, 2.0));
+    EXPECT_EQ((c128 - i).to<std::complex<double>>(), std::complex<double>(-4.0, 0.0));
+
+    EXPECT_EQ((i / Scalar(int64_t(3))).type(), ScalarType::Int64);
+    EXPECT_EQ((i / b).type(), ScalarType::Int64);
+    EXPECT_EQ((b / b).type(), ScalarType::Float64);
+    EXPECT_EQ((Scalar(std::numeric_limits<int64_t>::min()) / Scalar(int64_t(-1))).type(), ScalarType::Float64);
+
+    EXPECT_THROW(b + b, ScalarTypeError);
+    EXPECT_THROW(b - b, ScalarTypeError);
+    EXPECT_THROW(u - Scalar(uint64_t(5)), ScalarTypeError);
+    EXPECT_THROW(Scalar(int64_t(-1)) + u, ScalarTypeError); // -1 does not fit UInt64
+    EXPECT_THROW(i / Scalar(false), ScalarTypeError);
+    EXPECT_THROW(c128 / Scalar(std::complex<float>(0.0f, 0.0f)), ScalarTypeError);
+}
 
-    // This is not a strict test, but helps catch major performance regressions
-    EXPECT_LT(duration.count(), 1000); // Should complete within 1 second
-}
\ No newline at end of file
+// Narrow types are stored and computed as themselves
+TEST_F(ScalarTest, NarrowTypes)
+{
+    Scalar f(1.5f), g(0.25f);
+    EXPECT_EQ(f.type(), ScalarType::Float32);
+    EXPECT_EQ((f + g).type(), ScalarType::Float32);
+    EXPECT_EQ((f * g).to<float>(), 0.375f);
+    EXPECT_EQ((f / g).type(), ScalarType::Float32);
+    EXPECT_EQ((-f).type(), ScalarType::Float32);
+    EXPECT_EQ((f + Scalar(int32_t(2))).type(), ScalarType::Float32);
+    EXPECT_EQ((f + Scalar(2.0)).type(), ScalarType::Float64);
+    Scalar c(std::complex<float>(0.0f, 1.0f));
+    EXPECT_EQ((f + c).type(), ScalarType::Complex64);
+    EXPECT_EQ((c * f).type(), ScalarType::Complex64);
+    EXPECT_EQ((Scalar(int8_t(2)) * c).to<std::complex<float>>(), std::complex<float>(0.0f, 2.0f));
+    EXPECT_EQ((Scalar(int8_t(2)) * c).type(), ScalarType::Complex64);
+    EXPECT_EQ((c + Scalar(2.0)).type(), ScalarType::Complex128);
+    EXPECT_TRUE(Scalar(0.1f) == Scalar(0.1));
+
+    Scalar i8(int8_t(100)), i16(int16_t(1000)), u8(uint8_t(200));
+    EXPECT_EQ(i8.type(), ScalarType::Int8);
+    EXPECT_EQ(Scalar('a').type(), ScalarType::Int8);
+    EXPECT_EQ(Scalar(uint16_t(7)).type(), ScalarType::UInt16);
+    EXPECT_EQ(Scalar(7u).type(), ScalarType::UInt32);
+    EXPECT_EQ(Scalar(7ll).type(), ScalarType::Int64);
+    EXPECT_EQ((i8 + i16).type(), ScalarType::Int16);
+    EXPECT_EQ((i8 + i16).to<int16_t>(), 1100);
+    EXPECT_EQ((u8 + Scalar(int8_t(5))).type(), ScalarType::UInt8);
+    EXPECT_EQ((u8 + Scalar(int16_t(5))).type(), ScalarType::Int16);
+    EXPECT_EQ((Scalar(int8_t(-6)) / Scalar(int8_t(3))).type(), ScalarType::Int8);
+    EXPECT_THROW(i8 + i8, ScalarTypeError);
+    EXPECT_THROW(u8 * u8, ScalarTypeError);
+    EXPECT_THROW(-Scalar(int8_t(-128)), ScalarTypeError);
+    EXPECT_THROW(u8 + Scalar(int8_t(-1)), ScalarTypeError);
+    EXPECT_EQ(i8.toString(), "100");
+
+    // Explicit conversion, checked like to<T>()
+    Scalar narrowed = Scalar(2.0).to(ScalarType::Float32);
+    EXPECT_EQ(narrowed.type(), ScalarType::Float32);
+    EXPECT_EQ(narrowed.to<double>(), 2.0);
+    EXPECT_EQ(Scalar(300).to(ScalarType::Int16).to<int16_t>(), 300);
+    EXPECT_THROW(Scalar(300).to(ScalarType::Int8), ScalarTypeError);
+    EXPECT_THROW(Scalar(2.5).to(ScalarType::Int32), ScalarTypeError);
+    EXPECT_THROW(Scalar(1.0).to(ScalarType::Invalid), ScalarTypeError);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Allocator.h"
+#include "COW.h"
+#include "SharedMemory.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class SharedMemoryTest : public ::testing::Test
+{
+protected:
+    Device cpu_device;
+
+    void SetUp() override
+    {
+        cpu_device = Device(DeviceType::CPU);
+    }
+};
+
+TEST_F(SharedMemoryTest, ShareMemoryKeepsContents)
+{
+    Storage storage(1000, cpu_device);
+    std::memset(storage.data(), 9, 1000);
+    EXPECT_FALSE(storage.is_shared());
+
+    int fd = storage.share_memory();
+    EXPECT_GE(fd, 0);
+    EXPECT_TRUE(storage.is_shared());
+    EXPECT_TRUE(is_aligned(storage.data(), page_size()));
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[999], 9);
+
+    // Already shared: same object, no copy
+    void *data = storage.data();
+    EXPECT_EQ(storage.share_memory(), fd);
+    EXPECT_EQ(storage.data(), data);
+}
+
+// Two mappings of one object see each other's writes
+TEST_F(SharedMemoryTest, FromSharedHandleIsZeroCopy)
+{
+    Storage storage(4096, cpu_device);
+    int fd = storage.share_memory();
+
+    auto view = Storage::from_shared_handle(fd, 4096);
+    EXPECT_NE(view->data(), storage.data());
+    EXPECT_TRUE(view->is_shared());
+    static_cast<unsigned char *>(storage.data())[100] = 42;
+    EXPECT_EQ(static_cast<unsigned char *>(view->data())[100], 42);
+
+    // The view holds its own reference to the object
+    storage.resize(0);
+    storage.shrink_to_fit();
+    EXPECT_EQ(static_cast<unsigned char *>(view->data())[100], 42);
+
+    EXPECT_THROW(Storage::from_shared_handle(fd, 1 << 20), std::exception);
+}
+
+TEST_F(SharedMemoryTest, SharedAcrossFork)
+{
+    Storage storage(1 << 16, cpu_device);
+    std::memset(storage.data(), 0, 1 << 16);
+    int fd = storage.share_memory();
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+    {
+        // A separate mapping of the inherited descriptor, as a worker would get it
+        auto view = Storage::from_shared_handle(fd, 1 << 16);
+        std::memset(view->data(), 7, 1 << 16);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[0], 7);
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[(1 << 16) - 1], 7);
+}
+
+// Sharing a COW clone copies it out without touching the other owners
+TEST_F(SharedMemoryTest, ShareCOWStorage)
+{
+    Storage original(256, cpu_device);
+    std::memset(original.data(), 1, 256);
+    auto clone = Storage::lazy_clone(original);
+
+    clone->share_memory();
+    EXPECT_TRUE(clone->is_shared());
+    EXPECT_FALSE(clone->is_cow());
+    std::memset(clone->data(), 2, 256);
+    EXPECT_EQ(static_cast<unsigned char *>(original.data())[0], 1);
+}
+
+TEST_F(SharedMemoryTest, InvalidHandleThrows)
+{
+    EXPECT_THROW(Storage::from_shared_handle(-1, 16), std::system_error);
+    auto allocator = get_shared_memory_allocator();
+    int local = 0;
+    EXPECT_EQ(allocator->fd_of(&local), -1);
+    EXPECT_THROW(allocator->deallocate(&local), std::invalid_argument);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "Snapshot.h"
+#include "Storage.h"
+
+using namespace enigma;
+
+class SnapshotTest : public ::testing::Test
+{
+protected:
+    Device cpu_device;
+    std::vector<StoragePtr> storages;
+
+    void SetUp() override
+    {
+        cpu_device = Device(DeviceType::CPU);
+        for (int i = 0; i < 3; i++)
+        {
+            storages.push_back(Storage::create(1000, cpu_device));
+            std::memset(storages.back()->mutable_data(), i + 1, 1000);
+        }
+    }
+
+    static unsigned char byte(const StoragePtr &storage, size_t i)
+    {
+        return static_cast<const unsigned char *>(storage->const_data())[i];
+    }
+};
+
+TEST_F(SnapshotTest, VersionTracksWrites)
+{
+    Storage storage(100, cpu_device);
+    uint64_t version = storage.version();
+    storage.const_data();
+    EXPECT_EQ(storage.version(), version);
+    storage.mutable_data();
+    EXPECT_GT(storage.version(), version);
+
+    version = storage.version();
+    storage.resize(200);
+    EXPECT_GT(storage.version(), version);
+    version = storage.version();
+    storage.bump_version();
+    EXPECT_EQ(storage.version(), version + 1);
+}
+
+// Writes after the snapshot go to the originals only
+TEST_F(SnapshotTest, SnapshotIsFrozen)
+{
+    Snapshotter snapshotter(storages);
+    auto snapshot = snapshotter.snapshot();
+    ASSERT_EQ(snapshot->size(), 3u);
+    EXPECT_EQ(snapshot->id(), 1u);
+    EXPECT_EQ(snapshot->num_changed(), 3u);
+
+    std::memset(storages[1]->mutable_data(), 9, 1000);
+    EXPECT_EQ(byte((*snapshot)[1].storage, 0), 2);
+    EXPECT_EQ(byte(storages[1], 0), 9);
+}
+
+TEST_F(SnapshotTest, UnchangedStoragesAreSkipped)
+{
+    Snapshotter snapshotter(storages);
+    auto first = snapshotter.snapshot();
+    std::memset(storages[2]->mutable_data(), 7, 1000);
+
+    auto second = snapshotter.snapshot();
+    EXPECT_EQ(second->id(), 2u);
+    EXPECT_EQ(second->num_changed(), 1u);
+    EXPECT_FALSE((*second)[0].changed);
+    EXPECT_TRUE((*second)[2].changed);
+    // Still-alive clones are shared between snapshots
+    EXPECT_EQ((*second)[0].storage, (*first)[0].storage);
+    EXPECT_EQ(byte((*second)[2].storage, 0), 7);
+
+    // Without the previous snapshot, unchanged storages get a fresh clone
+    first.reset();
+    second.reset();
+    auto third = snapshotter.snapshot();
+    EXPECT_EQ(third->num_changed(), 0u);
+    EXPECT_EQ(byte((*third)[0].storage, 999), 1);
+}
+
+TEST_F(SnapshotTest, WriteAndReadBack)
+{
+    Snapshotter snapshotter(storages);
+    auto snapshot = snapshotter.snapshot();
+    std::memset(storages[0]->mutable_data(), 5, 1000);
+    auto incremental = snapshotter.snapshot();
+
+    std::stringstream full;
+    snapshot->write(full);
+    size_t num_entries = 0;
+    auto restored = Snapshot::read(full, &num_entries);
+    ASSERT_EQ(restored.size(), 3u);
+    EXPECT_EQ(num_entries, 3u);
+    EXPECT_EQ(byte(restored[0], 0), 1);
+    EXPECT_EQ(byte(restored[2], 999), 3);
+
+    std::stringstream changed;
+    incremental->write(changed, true);
+    restored = Snapshot::read(changed, &num_entries);
+    EXPECT_EQ(num_entries, 1u);
+    EXPECT_EQ(byte(restored[0], 0), 5);
+    EXPECT_FALSE(restored[1]);
+
+    std::stringstream garbage("not a snapshot");
+    EXPECT_THROW(Snapshot::read(garbage), std::runtime_error);
+}
+
+// Training writes while a background thread saves and then releases the snapshot
+TEST_F(SnapshotTest, AsyncWriteReleasesSnapshot)
+{
+    std::string path = "/tmp/enigma_snapshot_" + std::to_string(getpid());
+    Snapshotter snapshotter(storages);
+    auto pending = write_snapshot_async(snapshotter.snapshot(), path);
+    for (int step = 0; step < 100; step++)
+        std::memset(storages[step % 3]->mutable_data(), 50 + step, 1000);
+    pending.get();
+
+    // Nothing else shares the originals any more
+    for (auto &storage : storages)
+    {
+        storage->materialize();
+        EXPECT_FALSE(storage->is_cow());
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    auto restored = Snapshot::read(in);
+    EXPECT_EQ(byte(restored[0], 0), 1);
+    EXPECT_EQ(byte(restored[1], 0), 2);
+    EXPECT_EQ(byte(restored[2], 0), 3);
+    std::remove(path.c_str());
+}
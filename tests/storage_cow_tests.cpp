@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <thread>
 #include <vector>
+#include <sys/mman.h>
 #include "DataPtr.h"
 #include "Device.h"
 #include "DeviceType.h"
@@ -199,4 +202,412 @@ TEST_F(StorageTest, Cleanup)
 
     EXPECT_EQ(ctx->reference_count(), initial_count)
         << "Reference count not decreased after clone destruction";
-}
\ No newline at end of file
+}
+// Growing keeps the contents and capacity grows geometrically
+TEST_F(StorageTest, ResizePreservesContents)
+{
+    Storage storage(100, cpu_device);
+    std::memset(storage.data(), 7, 100);
+    EXPECT_EQ(storage.capacity_bytes(), 100u);
+
+    storage.resize(150);
+    EXPECT_EQ(storage.size_bytes(), 150u);
+    EXPECT_EQ(storage.capacity_bytes(), 200u);
+    for (size_t i = 0; i < 100; i++)
+        ASSERT_EQ(static_cast<unsigned char *>(storage.data())[i], 7);
+
+    // Within capacity the buffer does not move
+    void *data = storage.data();
+    storage.resize(200);
+    EXPECT_EQ(storage.data(), data);
+    storage.resize(10);
+    EXPECT_EQ(storage.data(), data);
+    EXPECT_EQ(storage.capacity_bytes(), 200u);
+}
+
+TEST_F(StorageTest, AppendsAreAmortized)
+{
+    Storage storage(0, cpu_device);
+    int reallocations = 0;
+    void *last = nullptr;
+    for (size_t size = 1; size <= 100000; size++)
+    {
+        storage.resize(size);
+        static_cast<unsigned char *>(storage.data())[size - 1] = static_cast<unsigned char>(size);
+        if (storage.data() != last)
+        {
+            reallocations++;
+            last = storage.data();
+        }
+    }
+    EXPECT_LE(reallocations, 20);
+    for (size_t size = 1; size <= 100000; size++)
+        ASSERT_EQ(static_cast<unsigned char *>(storage.data())[size - 1], static_cast<unsigned char>(size));
+}
+
+TEST_F(StorageTest, ReserveAndShrinkToFit)
+{
+    Storage storage(64, cpu_device);
+    std::memset(storage.data(), 3, 64);
+
+    storage.reserve(10000);
+    EXPECT_EQ(storage.size_bytes(), 64u);
+    EXPECT_GE(storage.capacity_bytes(), 10000u);
+    storage.reserve(100); // never shrinks
+    EXPECT_GE(storage.capacity_bytes(), 10000u);
+
+    storage.shrink_to_fit();
+    EXPECT_EQ(storage.capacity_bytes(), 64u);
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[63], 3);
+
+    storage.resize(0);
+    storage.shrink_to_fit();
+    EXPECT_EQ(storage.data(), nullptr);
+    EXPECT_EQ(storage.capacity_bytes(), 0u);
+}
+
+// A shared COW buffer is copied out of, never grown in place
+TEST_F(StorageTest, ResizeCOWStorage)
+{
+    Storage original(100, cpu_device);
+    original.reserve(1000);
+    std::memset(original.data(), 5, 100);
+    auto clone = Storage::lazy_clone(original);
+    EXPECT_EQ(original.capacity_bytes(), 100u);
+
+    original.resize(500);
+    EXPECT_NE(original.data(), clone->data());
+    EXPECT_FALSE(original.is_cow());
+    EXPECT_EQ(static_cast<unsigned char *>(original.data())[99], 5);
+
+    clone->resize(200);
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[99], 5);
+}
+
+// A materialized buffer is this Storage's own: shrinking keeps its
+// capacity, so growing back does not reallocate
+TEST_F(StorageTest, MaterializedStorageOwnsBuffer)
+{
+    Storage original(1000, cpu_device);
+    std::memset(original.data(), 4, 1000);
+    auto copied = Storage::lazy_clone(original);
+    auto handed_off = Storage::lazy_clone(original);
+
+    copied->materialize();
+    EXPECT_FALSE(copied->is_cow());
+    void *data = copied->data();
+    copied->resize(10);
+    EXPECT_EQ(copied->capacity_bytes(), 1000u);
+    copied->resize(800);
+    EXPECT_EQ(copied->data(), data);
+    EXPECT_EQ(static_cast<unsigned char *>(copied->data())[9], 4);
+
+    // Last reference: takes the original block back without copying
+    void *shared = handed_off->data();
+    original.set_data_ptr(DataPtr());
+    handed_off->materialize();
+    EXPECT_EQ(handed_off->data(), shared);
+    handed_off->resize(10);
+    handed_off->resize(1000);
+    EXPECT_EQ(handed_off->data(), shared);
+    EXPECT_EQ(static_cast<unsigned char *>(handed_off->data())[999], 4);
+}
+
+TEST_F(StorageTest, StoragePtrRefCount)
+{
+    StoragePtr storage = Storage::create(5000, cpu_device);
+    EXPECT_EQ(storage.use_count(), 1u);
+    {
+        StoragePtr copy = storage;
+        EXPECT_EQ(storage.use_count(), 2u);
+        EXPECT_EQ(copy.get(), storage.get());
+    }
+    EXPECT_EQ(storage.use_count(), 1u);
+
+    StoragePtr moved = std::move(storage);
+    EXPECT_FALSE(storage);
+    EXPECT_EQ(moved.use_count(), 1u);
+    moved.reset();
+    EXPECT_EQ(moved, nullptr);
+}
+
+// Small payloads sit right behind the Storage in the same allocation
+TEST_F(StorageTest, CoallocatedPayload)
+{
+    auto storage = Storage::create(256, cpu_device);
+    auto *header = reinterpret_cast<char *>(storage.get());
+    auto *data = static_cast<char *>(storage->data());
+    EXPECT_FALSE(storage->is_inline());
+    EXPECT_GE(data, header + sizeof(Storage));
+    EXPECT_LT(data, header + sizeof(Storage) + kDefaultAlignment);
+    EXPECT_TRUE(is_aligned(data, kDefaultAlignment));
+
+    auto large = Storage::create(Storage::kMaxCoallocatedBytes + 1, cpu_device);
+    EXPECT_EQ(large->capacity_bytes(), Storage::kMaxCoallocatedBytes + 1);
+
+    // Growing moves the data out of the block
+    std::memset(storage->data(), 4, 256);
+    storage->resize(4096);
+    EXPECT_EQ(static_cast<unsigned char *>(storage->data())[255], 4);
+}
+
+// A COW clone keeps the shared block alive after the Storage it lives in is gone
+TEST_F(StorageTest, CoallocatedPayloadOutlivesStorage)
+{
+    auto original = Storage::create(128, cpu_device);
+    std::memset(original->data(), 6, 128);
+    auto clone = Storage::lazy_clone(*original);
+    EXPECT_EQ(clone->data(), original->data());
+
+    original.reset();
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[127], 6);
+    clone->materialize();
+    EXPECT_FALSE(clone->is_cow());
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[0], 6);
+}
+
+// Tiny payloads live inside the Storage and are copied, not shared, by lazy_clone
+TEST_F(StorageTest, InlineSmallBuffer)
+{
+    Storage storage(Storage::kInlineBytes, cpu_device);
+    EXPECT_TRUE(storage.is_inline());
+    EXPECT_EQ(storage.capacity_bytes(), Storage::kInlineBytes);
+    EXPECT_TRUE(is_aligned(storage.data(), kDefaultAlignment));
+    std::memset(storage.data(), 3, Storage::kInlineBytes);
+
+    auto clone = Storage::lazy_clone(storage);
+    EXPECT_TRUE(clone->is_inline());
+    EXPECT_FALSE(clone->is_cow());
+    EXPECT_NE(clone->data(), storage.data());
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[0], 3);
+    clone->materialize();
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[Storage::kInlineBytes - 1], 3);
+
+    // Stricter alignment, or a payload past the buffer, goes to the allocator
+    EXPECT_FALSE(Storage(16, cpu_device, 4096).is_inline());
+    EXPECT_FALSE(Storage(Storage::kInlineBytes + 1, cpu_device).is_inline());
+    EXPECT_FALSE(Storage(0, cpu_device).is_inline());
+
+    // Outgrowing the buffer moves the data to the heap
+    storage.resize(1000);
+    EXPECT_FALSE(storage.is_inline());
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[Storage::kInlineBytes - 1], 3);
+}
+
+// Clones made, written after materializing and dropped on many threads at once
+TEST_F(StorageTest, ConcurrentCloneAndMaterialize)
+{
+    Storage original(4096, cpu_device);
+    std::memset(original.data(), 1, 4096);
+    auto keep = Storage::lazy_clone(original);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+                                 for (int i = 0; i < 200; i++)
+                                 {
+                                     auto clone = Storage::lazy_clone(*keep);
+                                     if (i % 4 == 0)
+                                     {
+                                         clone->materialize();
+                                         std::memset(clone->data(), t + 2, 4096);
+                                     }
+                                     EXPECT_EQ(static_cast<unsigned char *>(clone->data())[4095], i % 4 == 0 ? t + 2 : 1);
+                                 }
+                             });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    auto *ctx = static_cast<cow::COWDeleterContext *>(original.data_ptr().get_context());
+    EXPECT_EQ(ctx->reference_count(), 2);
+    EXPECT_EQ(static_cast<unsigned char *>(original.data())[0], 1);
+}
+
+// Writes copy only the chunks they touch; untouched chunks stay shared
+TEST_F(StorageTest, ChunkedCOWCopiesTouchedChunks)
+{
+    constexpr size_t kChunk = Storage::kCOWChunkBytes;
+    constexpr size_t kSize = 8 * kChunk + 100;
+    Storage original(kSize, cpu_device);
+    std::memset(original.data(), 1, kSize);
+
+    auto clone = Storage::lazy_clone_chunked(original);
+    ASSERT_TRUE(clone->is_chunked());
+    EXPECT_TRUE(clone->is_cow());
+    EXPECT_EQ(clone->const_data(0, kChunk), original.data());
+    EXPECT_EQ(clone->data(), original.data());
+    EXPECT_TRUE(clone->is_chunked());
+
+    std::memset(clone->mutable_data(3 * kChunk + 10, 20), 2, 20);
+    EXPECT_NE(clone->const_data(3 * kChunk, kChunk), static_cast<char *>(original.data()) + 3 * kChunk);
+    EXPECT_EQ(clone->const_data(2 * kChunk, kChunk), static_cast<char *>(original.data()) + 2 * kChunk);
+    EXPECT_EQ(static_cast<const unsigned char *>(clone->const_data(3 * kChunk, kChunk))[0], 1);
+    EXPECT_EQ(static_cast<const unsigned char *>(clone->const_data(3 * kChunk, kChunk))[10], 2);
+    EXPECT_EQ(static_cast<unsigned char *>(original.data())[3 * kChunk + 10], 1);
+
+    // Only the written chunk has pages behind it
+    std::vector<unsigned char> resident(kSize / page_size() + 1);
+    ASSERT_EQ(mincore(clone->data_ptr().get(), kSize, resident.data()), 0);
+    size_t pages = std::count_if(resident.begin(), resident.end(), [](unsigned char r) { return r & 1; });
+    EXPECT_EQ(pages, kChunk / page_size());
+
+    // The tail chunk is partial
+    std::memset(clone->mutable_data(kSize - 1, 1), 3, 1);
+    EXPECT_EQ(static_cast<unsigned char *>(original.data())[kSize - 1], 1);
+
+    // Reads never copy: a range over both copied and shared chunks has no
+    // single buffer until materialize()
+    EXPECT_THROW(clone->data(), std::runtime_error);
+    EXPECT_THROW(clone->const_data(2 * kChunk, 2 * kChunk), std::runtime_error);
+    EXPECT_TRUE(clone->is_chunked());
+
+    auto copy = clone->to(cpu_device);
+    EXPECT_EQ(static_cast<const unsigned char *>(copy->const_data())[3 * kChunk + 10], 2);
+    EXPECT_EQ(static_cast<const unsigned char *>(copy->const_data())[kSize - 2], 1);
+    EXPECT_TRUE(clone->is_chunked());
+
+    clone->materialize();
+    auto *bytes = static_cast<unsigned char *>(clone->data());
+    EXPECT_FALSE(clone->is_chunked());
+    EXPECT_FALSE(clone->is_cow());
+    EXPECT_EQ(bytes[0], 1);
+    EXPECT_EQ(bytes[3 * kChunk + 10], 2);
+    EXPECT_EQ(bytes[kSize - 1], 3);
+
+    EXPECT_THROW(clone->mutable_data(kSize, 1), std::out_of_range);
+}
+
+// A chunked clone outlives its source and can itself be cloned
+TEST_F(StorageTest, ChunkedCOWLifetime)
+{
+    constexpr size_t kSize = 4 * Storage::kCOWChunkBytes;
+    auto original = Storage::create(kSize, cpu_device);
+    std::memset(original->data(), 5, kSize);
+    auto clone = Storage::lazy_clone_chunked(*original);
+    original.reset();
+
+    std::memset(clone->mutable_data(0, 1), 6, 1);
+    auto second = Storage::lazy_clone(*clone);
+    EXPECT_FALSE(clone->is_chunked());
+    EXPECT_EQ(static_cast<unsigned char *>(second->data())[0], 6);
+    EXPECT_EQ(static_cast<unsigned char *>(second->data())[kSize - 1], 5);
+
+    // Too small to chunk
+    Storage small(1000, cpu_device);
+    EXPECT_FALSE(Storage::lazy_clone_chunked(small)->is_chunked());
+    EXPECT_THROW(Storage::lazy_clone_chunked(small, 1000), std::invalid_argument);
+}
+
+// Clones of a memfd-backed Storage are private mappings: writes stay on their side
+TEST_F(StorageTest, KernelCOWIsolatesWrites)
+{
+    constexpr size_t kSize = 4 << 20;
+    auto original = Storage::create_kernel_cow(kSize);
+    ASSERT_TRUE(cow::is_kernel_cow_data_ptr(original->data_ptr()));
+    std::memset(original->data(), 1, kSize);
+
+    auto clone = Storage::lazy_clone(*original);
+    EXPECT_TRUE(cow::is_kernel_cow_data_ptr(clone->data_ptr()));
+    EXPECT_FALSE(clone->is_cow());
+    EXPECT_NE(clone->data(), original->data());
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[kSize - 1], 1);
+
+    // No materialize needed in either direction
+    static_cast<unsigned char *>(clone->data())[0] = 2;
+    static_cast<unsigned char *>(original->data())[kSize - 1] = 3;
+    EXPECT_EQ(static_cast<unsigned char *>(original->data())[0], 1);
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[kSize - 1], 1);
+
+    // The file outlives the original's mapping
+    original.reset();
+    EXPECT_EQ(static_cast<unsigned char *>(clone->data())[1], 1);
+}
+
+// A mapping with pages of its own no longer matches the file
+TEST_F(StorageTest, KernelCOWFallsBackAfterWrites)
+{
+    constexpr size_t kSize = 2 << 20;
+    auto original = Storage::create_kernel_cow(kSize);
+    std::memset(original->data(), 4, kSize);
+    auto first = Storage::lazy_clone(*original);
+
+    // Untouched since the freeze: still a kernel clone
+    auto second = Storage::lazy_clone(*first);
+    EXPECT_TRUE(cow::is_kernel_cow_data_ptr(second->data_ptr()));
+
+    static_cast<unsigned char *>(first->data())[100] = 5;
+    auto third = Storage::lazy_clone(*first);
+    EXPECT_TRUE(third->is_cow());
+    EXPECT_EQ(third->data(), first->data());
+    EXPECT_EQ(static_cast<unsigned char *>(third->data())[100], 5);
+    EXPECT_EQ(static_cast<unsigned char *>(second->data())[100], 4);
+
+    // Small buffers are ordinary Storages
+    auto small = Storage::create_kernel_cow(4096);
+    EXPECT_FALSE(cow::is_kernel_cow_data_ptr(small->data_ptr()));
+    EXPECT_TRUE(Storage::lazy_clone(*small)->is_cow());
+}
+
+// mutable_data() does the materialize users used to forget
+TEST_F(StorageTest, MutableDataMaterializes)
+{
+    Storage original(1000, cpu_device);
+    std::memset(original.mutable_data(), 1, 1000);
+    void *buffer = original.data();
+    EXPECT_EQ(original.mutable_data(), buffer);
+
+    auto clone = Storage::lazy_clone(original);
+    EXPECT_EQ(clone->const_data(), buffer);
+    EXPECT_TRUE(clone->is_cow());
+
+    std::memset(clone->mutable_data(), 2, 1000);
+    EXPECT_FALSE(clone->is_cow());
+    EXPECT_NE(clone->const_data(), buffer);
+    EXPECT_EQ(static_cast<const unsigned char *>(original.const_data())[0], 1);
+
+    // The last COW reference takes the buffer back without copying
+    EXPECT_TRUE(original.is_cow());
+    EXPECT_EQ(original.mutable_data(), buffer);
+    EXPECT_FALSE(original.is_cow());
+    EXPECT_EQ(static_cast<const unsigned char *>(clone->const_data())[999], 2);
+}
+
+TEST_F(StorageTest, COWStatsCountClonesAndCopies)
+{
+    cow::reset_cow_stats();
+    auto before = cow::cow_stats();
+    EXPECT_EQ(before.clones, 0);
+    EXPECT_EQ(before.bytes_copied, 0);
+
+    {
+        Storage original(1000, cpu_device);
+        auto a = Storage::lazy_clone(original);
+        auto b = Storage::lazy_clone(original);
+        EXPECT_EQ(cow::cow_stats().live_contexts, before.live_contexts + 1);
+
+        a->materialize(); // copies
+        b.reset();
+        original.materialize(); // last reference: hands off
+    }
+
+    auto after = cow::cow_stats();
+    EXPECT_EQ(after.clones, 2);
+    EXPECT_EQ(after.copies, 1);
+    EXPECT_EQ(after.handoffs, 1);
+    EXPECT_EQ(after.bytes_cloned, 2000);
+    EXPECT_EQ(after.bytes_copied, 1000);
+    EXPECT_EQ(after.bytes_avoided, 1000);
+    EXPECT_GE(after.copy_ns, 0);
+    EXPECT_EQ(after.live_contexts, before.live_contexts);
+
+    // Chunked clones count only the chunks they copy
+    cow::reset_cow_stats();
+    Storage large(4 * Storage::kCOWChunkBytes, cpu_device);
+    auto chunked = Storage::lazy_clone_chunked(large);
+    chunked->mutable_data(0, 1);
+    EXPECT_EQ(cow::cow_stats().bytes_copied, static_cast<int64_t>(Storage::kCOWChunkBytes));
+    EXPECT_EQ(cow::cow_stats().bytes_avoided, static_cast<int64_t>(3 * Storage::kCOWChunkBytes));
+}
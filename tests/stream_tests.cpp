@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "MemoryStats.h"
+#include "Storage.h"
+#include "Stream.h"
+
+using namespace enigma;
+
+class StreamTest : public ::testing::Test
+{
+protected:
+    Device cpu_device = Device(DeviceType::CPU);
+};
+
+TEST_F(StreamTest, RunsWorkInOrder)
+{
+    Stream stream(cpu_device);
+    std::vector<int> order;
+    for (int i = 0; i < 100; i++)
+        stream.launch([&order, i]
+                      { order.push_back(i); });
+    stream.synchronize();
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(order[i], i);
+    EXPECT_TRUE(stream.query());
+
+    EXPECT_THROW(Stream(Device(DeviceType::SIM)), std::invalid_argument);
+    EXPECT_THROW(stream.launch(nullptr), std::invalid_argument);
+}
+
+TEST_F(StreamTest, SynchronizeRethrowsWorkErrors)
+{
+    Stream stream(cpu_device);
+    std::atomic<bool> ran_after{false};
+    stream.launch([]
+                  { throw std::runtime_error("kernel failed"); });
+    stream.launch([&]
+                  { ran_after = true; });
+    EXPECT_THROW(stream.synchronize(), std::runtime_error);
+    EXPECT_TRUE(ran_after);
+    EXPECT_NO_THROW(stream.synchronize());
+}
+
+// Work queued after wait() on one stream sees what the other stream did
+// before the event
+TEST_F(StreamTest, EventsOrderStreams)
+{
+    Stream producer(cpu_device), consumer(cpu_device);
+    std::atomic<bool> release{false};
+    int value = 0, seen = -1;
+
+    producer.launch([&]
+                    {
+        while (!release)
+            std::this_thread::yield();
+        value = 42; });
+    Event produced = producer.record();
+    EXPECT_FALSE(produced.query());
+
+    consumer.wait(produced);
+    consumer.launch([&]
+                    { seen = value; });
+    Event consumed = consumer.record();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_FALSE(consumed.query());
+
+    release = true;
+    consumed.synchronize();
+    EXPECT_EQ(seen, 42);
+    EXPECT_TRUE(produced.query());
+    EXPECT_GE(produced.elapsed_ms(consumed), 0.0);
+
+    Event never_recorded;
+    EXPECT_TRUE(never_recorded.query());
+    EXPECT_THROW(never_recorded.elapsed_ms(consumed), std::runtime_error);
+}
+
+// A Storage dropped while queued work still writes its buffer keeps the
+// buffer until the stream gets past that work
+TEST_F(StreamTest, RecordStreamDefersDeallocation)
+{
+    Stream stream(cpu_device);
+    std::atomic<bool> release{false};
+    int64_t before = memory_stats(cpu_device).current_bytes;
+
+    auto storage = Storage::create(1 << 20, cpu_device);
+    auto *bytes = static_cast<unsigned char *>(storage->mutable_data());
+    stream.launch([&release, bytes]
+                  {
+        while (!release)
+            std::this_thread::yield();
+        std::memset(bytes, 1, 1 << 20); });
+    storage->record_stream(stream);
+    storage->record_stream(stream);
+    storage.reset();
+
+    EXPECT_GE(memory_stats(cpu_device).current_bytes, before + (1 << 20));
+    release = true;
+    stream.synchronize();
+    EXPECT_EQ(memory_stats(cpu_device).current_bytes, before);
+}
+
+TEST_F(StreamTest, RecordStreamOnInlineAndResizedStorage)
+{
+    Stream stream(cpu_device);
+    std::atomic<int> seen{0};
+    {
+        Storage storage(16, cpu_device);
+        ASSERT_TRUE(storage.is_inline());
+        std::memset(storage.mutable_data(), 9, 16);
+        // The payload leaves the inline buffer, which cannot outlive the Storage
+        storage.record_stream(stream);
+        EXPECT_FALSE(storage.is_inline());
+        EXPECT_EQ(static_cast<unsigned char *>(storage.data())[15], 9);
+        auto *bytes = static_cast<const unsigned char *>(storage.const_data());
+        stream.launch([bytes, &seen]
+                      {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            seen = bytes[15]; });
+        // The old block stays readable by the queued work
+        storage.resize(4096);
+        EXPECT_EQ(static_cast<unsigned char *>(storage.data())[15], 9);
+    }
+    stream.synchronize();
+    EXPECT_EQ(seen, 9);
+
+    Stream other(cpu_device);
+    int64_t before = memory_stats(cpu_device).current_bytes;
+    Storage storage(4096, cpu_device);
+    storage.record_stream(other);
+    std::atomic<bool> release{false};
+    other.launch([&]
+                 {
+        while (!release)
+            std::this_thread::yield(); });
+    // The old block is not reallocated in place while the stream may use it
+    storage.resize(1 << 20);
+    EXPECT_GE(memory_stats(cpu_device).current_bytes, before + (1 << 20) + 4096);
+    release = true;
+    other.synchronize();
+    EXPECT_LT(memory_stats(cpu_device).current_bytes, before + (1 << 20) + 4096);
+}
+
+// The last reference may go away inside work on the recorded stream itself
+TEST_F(StreamTest, LastReferenceDroppedByStreamWork)
+{
+    Stream stream(cpu_device);
+    std::atomic<bool> release{false};
+    stream.launch([&release]
+                  {
+        while (!release)
+            std::this_thread::yield(); });
+
+    for (size_t size : {size_t(32), size_t(1) << 16})
+    {
+        auto storage = Storage::create(size, cpu_device);
+        storage->record_stream(stream);
+        stream.launch([storage, size]
+                      { std::memset(storage->mutable_data(), 1, size); });
+        storage.reset();
+    }
+    release = true;
+    stream.synchronize();
+}
+
+// Moving into shared memory lets go of the old buffer like any reallocation
+TEST_F(StreamTest, RecordStreamThenShareMemory)
+{
+    Stream stream(cpu_device);
+    std::atomic<bool> release{false};
+    Storage storage(1 << 20, cpu_device);
+    auto *bytes = static_cast<unsigned char *>(storage.mutable_data());
+    std::memset(bytes, 3, 1 << 20);
+    storage.record_stream(stream);
+    stream.launch([&release, bytes]
+                  {
+        while (!release)
+            std::this_thread::yield();
+        std::memset(bytes, 1, 1 << 20); });
+
+    storage.share_memory();
+    EXPECT_TRUE(storage.is_shared());
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[0], 3);
+    // The old block is not handed out while the queued work still writes it
+    Storage probe(1 << 20, cpu_device);
+    EXPECT_NE(probe.data(), bytes);
+
+    release = true;
+    stream.synchronize();
+    EXPECT_EQ(static_cast<unsigned char *>(storage.data())[(1 << 20) - 1], 3);
+}
+
+// Once the stream is gone there is nothing left to wait for
+TEST_F(StreamTest, StorageOutlivesStream)
+{
+    int64_t before = memory_stats(cpu_device).current_bytes;
+    auto storage = Storage::create(1 << 16, cpu_device);
+    {
+        Stream stream(cpu_device);
+        storage->record_stream(stream);
+        stream.launch([bytes = storage->mutable_data()]
+                      { std::memset(bytes, 0, 1 << 16); });
+    }
+    storage.reset();
+    EXPECT_EQ(memory_stats(cpu_device).current_bytes, before);
+}